@@ -22,10 +22,11 @@ see the files COPYING and COPYING.LESSER. If not, see
 #ifndef _X_ADDRESS_H_
 #define _X_ADDRESS_H_
 
-/* NB as at 21/10/2013 these are just prototypes - the code has not been written yet */
-
 /* These routines provide for conversion between host and epiphany global
-   addresses. 
+   addresses - see x_address.c. NULL is returned for an address that 
+   cannot be converted. 
+   In an Epiphany task the shared memory conversions do nothing, since 
+   Epiphany programs only ever see Epiphany addresses. 
 */
 
 void * x_host_to_epiphany_shared_memory_address (void * host_shared_memory_address);
@@ -33,6 +34,9 @@ void * x_epiphany_to_host_shared_memory_address (void * epiphany_shared_memory_a
 
 /* These routines are host-side only, because the Epiphany cores do not
    know where in host address space the core memory has been mapped.
+   Global addresses in shared memory are also accepted, so that the 
+   address of a peer's endpoint can be converted without knowing whether
+   the peer is a host or an Epiphany task. 
 */
 
 #ifndef __epiphany__
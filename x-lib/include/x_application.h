@@ -91,6 +91,9 @@ x_return_stat_t x_initialize_application (const char * caller_executable_file_na
 #define X_CORE_NEAREST           (0x80000000)
 #define X_ANY_CORE               (0xF0000000)
 
+/* Core ID for a task that runs as a process on the host */
+#define X_HOST_PROCESS           (0x08000000)
+
 x_task_id_t x_create_task (const char *executable_file_name, int core_id);
 
 /* Many applications are SPMD meshes - x_mesh_application sets up the application for 
@@ -121,11 +124,40 @@ x_return_stat_t x_prepare_mesh_application (
 /* The keys used in making connections can be any integer value, but
    a core cannot have connections with duplicate keys. 
    Connections can only be made prior to tasks being started. 
+   A connection between two host tasks is in fact buffered - it has a 
+   ring in host shared memory (see x_connect_tasks_buffered) big enough
+   for the largest message, so the sender does not wait for the 
+   receiver unless the ring is full. 
 */
 
 x_return_stat_t x_connect_tasks (x_task_id_t sender,   int sender_key, 
                                  x_task_id_t receiver, int receiver_key);
 
+/* A buffered connection lets the sender carry on as soon as its message 
+   has been written into a ring buffer of buffer_size bytes in the 
+   receiver's memory, rather than waiting for the receiver. Both tasks 
+   must be workgroup tasks, the ring being allocated on the receiver's 
+   stack - or both host tasks, in which case the ring is in host shared
+   memory. A host task cannot be buffered to a workgroup task. 
+   Each message takes up its size plus 4 bytes, rounded up to 8. 
+*/
+
+x_return_stat_t x_connect_tasks_buffered (x_task_id_t sender,   int sender_key, 
+                                          x_task_id_t receiver, int receiver_key,
+                                          size_t buffer_size);
+
+/* A multicast connection joins one sending key to several receivers, 
+   each with its own key. A single x_sync_send on the sender's endpoint
+   delivers the message to all of them, overlapping the transfers. The 
+   receivers use x_sync_receive as usual. There may be up to 
+   X_MULTICAST_MAX_RECEIVERS receivers. 
+*/
+
+x_return_stat_t x_connect_tasks_multicast (x_task_id_t sender, int sender_key,
+                                           int num_receivers,
+                                           const x_task_id_t receivers[],
+                                           const int receiver_keys[]);
+
 /*----------------------------- Task execution -----------------------------*/
 
 x_return_stat_t x_launch_task (x_task_id_t task_id, ...);
@@ -77,15 +77,36 @@ typedef struct {
 	x_memory_offset_t           connection_index;
 	volatile x_task_state_t     state;     // any -ve value indicates failure.
 	volatile x_task_heartbeat_t heartbeat; // copy of heartbeat from core mem
-	char                        status[100];
+	volatile uint32_t           barrier_flags; // global address, see x_barrier
+	x_memory_offset_t           host_endpoints;  // host tasks only, see below
+	char                        status[92];
 } x_task_descriptor_t;
 
+/* The endpoints of a task are looked up by key in an on-core index, 
+   sorted by key, that is built at startup - see x_get_endpoint. The 
+   index is separate from the endpoint list, which must stay in the 
+   order of the task's connection list so that the endpoints of a 
+   multicast connection are consecutive. The eight mesh keys (X_FROM_LEFT
+   etc, see x_application.h) are also indexed directly by the top four
+   bits of the key. 
+*/
+
+#define X_MESH_KEYS (8)
+
+typedef struct {
+	int                   key;
+	x_endpoint_t         *endpoint;
+} x_key_index_entry_t;
+
 typedef struct {
 	x_task_id_t           task_id;
 	x_task_descriptor_t  *descriptor;
 	x_task_heartbeat_t    heartbeat;
 	int                   num_endpoints;
 	x_endpoint_t         *endpoints;
+	int                   num_keys;
+	x_key_index_entry_t  *key_index;
+	x_endpoint_t         *mesh_endpoints[X_MESH_KEYS];
 } x_task_control_t;
 
 
@@ -111,6 +132,7 @@ typedef struct {
 	unsigned int      workgroup_rows;
 	unsigned int      workgroup_columns;
 	unsigned int      host_task_slots;
+	unsigned int      mesh_options;    // as given to x_prepare_mesh_application
 	unsigned int      connection_list_length;
 	x_memory_offset_t task_descriptor_table_offset;
 	x_memory_offset_t connection_list_offset;
@@ -119,18 +141,54 @@ typedef struct {
 	char              working_memory[X_APPLICATION_WORKING_MEMORY_SIZE];
 } x_application_t;	
 
-/* Future:
+/* Host task endpoints
+
+   The endpoints of a host task must be reachable from the Epiphany cores,
+   so they are placed in the XLIB section of shared DRAM beyond the end of
+   the application data, in an area allocated when the connections are set
+   up. The host_endpoints offset in the task descriptor locates it (like
+   the other offsets, relative to the x_application_t structure). 
+   
+   The area holds the task's doorbell word (padded to a doubleword), its
+   endpoints, and then a staging buffer of X_HOST_STAGING_SIZE bytes per
+   endpoint. Data to and from a host task pass through the staging buffer,
+   so that the cores move the data with their DMA engines and the host 
+   never writes data over the slow path into core memory - see 
+   x_sync_send in x_sync.c. 
+*/
+
+#define X_HOST_ENDPOINTS_OFFSET (8)
+#define X_HOST_STAGING_OFFSET(_ENDPOINTS) \
+            ((X_HOST_ENDPOINTS_OFFSET + (_ENDPOINTS)*sizeof(x_endpoint_t) + 7) & ~7)
+#define X_HOST_ENDPOINT_AREA_SIZE(_ENDPOINTS) \
+            (X_HOST_STAGING_OFFSET(_ENDPOINTS) + (_ENDPOINTS)*X_HOST_STAGING_SIZE)
 
-   Need to provide for buffers that host tasks can use for communication. 
-   Alternatively the semantics
-   for host communication can be different - i.e. host always reads or writes
-   instead of "sender writes" - then epiphany-accessible host buffers are
-   not needed. 
-   What then of host-host communication? Use Unix primitives?
+/* A host task is a separate process, started by x_launch_task, which 
+   finds its task ID in this environment variable. 
 */
 
+#define X_TASK_ID_ENVIRONMENT_VARIABLE "XLIB_TASK_ID"
+
 
 extern x_application_t *x_application;
 
+/* Flag words written by the peers in x_barrier, one per round. */
+
+extern volatile uint32_t x_barrier_flags[X_BARRIER_MAX_ROUNDS];
+
+/* Sets the calling task's state in its descriptor, returning the previous
+   state so that it can be restored - for the *_WAITING_TASK states. 
+*/
+
+x_task_state_t xt_set_task_state (x_task_state_t state);
+
+/* Returns the (host) address of the staging buffer of a host task's 
+   endpoint. 
+*/
+
+#ifndef __epiphany__
+void * xt_host_staging_buffer (x_endpoint_t * endpoint);
+#endif
+
 
 #endif /* _X_APPLICATION_INTERNALS_H_ */
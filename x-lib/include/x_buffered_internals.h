@@ -0,0 +1,60 @@
+/*
+File: x_buffered_internals.h
+
+Copyright 2013 Mark Honman
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/* Internal-use functions for buffered connections, in which the sender
+   writes messages into a ring buffer in the receiver's local memory and
+   carries on without waiting for the receiver. 
+
+   The synchronous messaging functions hand over to these when they are
+   given a buffered endpoint, see x_buffered.c. 
+*/
+
+#ifndef _X_BUFFERED_INTERNALS_H_
+#define _X_BUFFERED_INTERNALS_H_
+
+#include "x_types.h"
+#include "x_connection_internals.h"
+
+/* Ring buffers are made up of doubleword-aligned records, so that the 
+   data can be copied with doubleword transfers when the user's buffer
+   is also doubleword aligned. 
+*/
+
+#define XB_RING_ALIGNMENT          (8)
+#define XB_RING_BYTES(buffer_size) (((buffer_size) + XB_RING_ALIGNMENT - 1) & \
+                                    ~(XB_RING_ALIGNMENT - 1))
+
+int xb_send (x_endpoint_t * local_endpoint, const void * buf, 
+             x_transfer_size_t size);
+
+int xb_receive (x_endpoint_t * local_endpoint, void * buf, 
+                x_transfer_size_t size);
+
+x_bool_t xb_ready (x_endpoint_t * local_endpoint);
+
+x_bool_t xb_room_for (x_endpoint_t * local_endpoint, x_transfer_size_t size);
+
+void xb_initialise_receiver (x_endpoint_t * local_endpoint, void * ring, 
+                             uint32_t ring_bytes);
+
+void xb_post_ring (x_endpoint_t * local_endpoint);
+
+#endif /* _X_BUFFERED_INTERNALS_H_ */
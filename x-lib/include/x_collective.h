@@ -0,0 +1,122 @@
+/*
+File: x_collective.h
+
+Copyright 2013 Mark Honman
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _X_COLLECTIVE_H_
+#define _X_COLLECTIVE_H_
+
+/* Collective operations for mesh applications, built on the connections
+   made by x_prepare_mesh_application (the X_TO_LEFT, X_FROM_RIGHT etc.
+   keys). Every Epiphany task in the workgroup must make the same call
+   with the same arguments, otherwise the collective will deadlock. 
+
+   The root of a collective is identified by its task ID, which for the
+   workgroup tasks of a mesh application is (row * columns) + column.
+*/
+
+#include <unistd.h>
+#include <x_types.h>
+#include <x_task_types.h>
+
+/* x_broadcast copies size bytes from buf in the root task into buf in
+   all of the other tasks. 
+   
+   The data is passed along the root's row, then up and down each column.
+   It is split into segments of X_COLLECTIVE_SEGMENT_SIZE bytes, and each 
+   task forwards a segment while receiving the next, so the time taken is 
+   roughly (rows + columns) hops of one segment plus the time to move the
+   whole buffer once. 
+*/
+
+x_return_stat_t x_broadcast (x_task_id_t root, void *buf, size_t size);
+
+/* Element types and operations for the reductions */
+
+#define X_REDUCE_INT32 (0)
+#define X_REDUCE_FLOAT (1)
+
+#define X_REDUCE_SUM   (0)
+#define X_REDUCE_MIN   (1)
+#define X_REDUCE_MAX   (2)
+
+/* x_reduce combines the count elements of buf in every task, element by
+   element, leaving the result in buf in the root task. The buffers of 
+   the other tasks are overwritten with partial results. 
+   The partial results flow back up the tree used by x_broadcast.
+
+   x_allreduce leaves the result in buf in every task. If the mesh was
+   made with X_WRAPAROUND_MESH, the rows and then the columns are reduced
+   around rings (a reduce-scatter followed by an allgather), otherwise it
+   is a reduce to task 0 followed by a broadcast. 
+   Either way each element is combined in only one task and then copied,
+   so all tasks get bit-identical floating point results and can safely
+   use them to make the same decision, e.g. on convergence. 
+*/
+
+x_return_stat_t x_reduce (x_task_id_t root, void *buf, int count, 
+                          int type, int op);
+
+x_return_stat_t x_allreduce (void *buf, int count, int type, int op);
+
+/* x_barrier returns once every workgroup task has called it. 
+   It uses a dissemination algorithm, taking log2(tasks) rounds, over 
+   flag words in each core's local memory rather than the mesh 
+   connections. While waiting, the task state is X_BARRIER_WAITING_TASK,
+   so the host's task list shows which tasks have yet to arrive. 
+*/
+
+x_return_stat_t x_barrier (void);
+
+/* x_alltoall sends a distinct block of block_size bytes from every task
+   to every task (including itself). The send buffer holds one block per
+   task in task ID order, and on return block i of the receive buffer 
+   holds the block sent to this task by task i. 
+   
+   The blocks are passed around the row rings and then the column rings,
+   so a mesh made with X_WRAPAROUND_MESH is needed. The workspace must 
+   be at least X_ALLTOALL_WORKSPACE_SIZE bytes. The largest message is
+   (columns - 1) * rows blocks or (rows - 1) * columns blocks, and must 
+   not exceed the 64kB limit on a single transfer. 
+*/
+
+#define X_ALLTOALL_WORKSPACE_SIZE(_TASKS,_BLOCK_SIZE) (3 * (_TASKS) * (_BLOCK_SIZE))
+
+x_return_stat_t x_alltoall (const void *send_buf, void *receive_buf,
+                            size_t block_size, void *workspace);
+
+/* x_halo_exchange swaps the edges of a 2D tile with the four mesh 
+   neighbours, as needed by stencil codes. The tile is stored by rows, 
+   with a halo of halo_depth elements all round the width x height 
+   interior, i.e. as (height + 2*halo_depth) rows of 
+   (width + 2*halo_depth) elements of element_size bytes. 
+   
+   The outermost halo_depth interior rows and columns are sent to the
+   neighbour on that side, and the halo on each side is filled from the
+   neighbour there. The corners of the halo are not filled. Without 
+   X_WRAPAROUND_MESH, the halo on the outside edges of the mesh is left
+   untouched. All eight transfers are done in a single exchange, the
+   columns as strided transfers, so the time taken is roughly that of 
+   the slowest neighbour. 
+*/
+
+x_return_stat_t x_halo_exchange (void *local_tile, int width, int height,
+                                 int halo_depth, size_t element_size);
+
+#endif /* _X_COLLECTIVE_H_ */
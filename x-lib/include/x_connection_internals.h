@@ -27,12 +27,19 @@ see the files COPYING and COPYING.LESSER. If not, see
 #ifndef _X_CONNECTION_INTERNALS_H_
 #define _X_CONNECTION_INTERNALS_H_
 
+#include "x_types.h"
 #include "x_task_types.h"
 
 typedef enum {
         X_UNINITIALISED_ENDPOINT = 0,
         X_SENDING_ENDPOINT       = 1,
         X_RECEIVING_ENDPOINT     = 2,
+        X_BUFFERED_SENDING_ENDPOINT   = 3,
+        X_BUFFERED_RECEIVING_ENDPOINT = 4,
+        X_MULTICAST_SENDING_ENDPOINT  = 5,
+        X_MULTICAST_MEMBER_ENDPOINT   = 6,
+        X_HOST_RING_SENDING_ENDPOINT   = 7,
+        X_HOST_RING_RECEIVING_ENDPOINT = 8,
 } x_endpoint_mode_t;
 
 /* Note on "ready" status
@@ -56,27 +63,100 @@ typedef uint32_t x_transfer_sequence_t;
 
 #define X_ENDPOINT_SYNC_CONTROL   ((x_transfer_control_t)0)
 
+/* Transfer sizes fit in the low 16 bits of the control word, leaving the
+   upper bits for flags describing the form of the receiver's buffer. 
+   When the vector flag is set the address is that of a list of segments
+   (x_iovec_t), bits 16-28 hold the number of segments and the low 16 
+   bits their total size. 
+   When the strided flag is set the address is that of a strided layout
+   (x_stride_t) and the low 16 bits hold its total size. 
+   When the large flag is set the buffer is contiguous and the low 29 bits
+   hold its size, which may exceed the 16-bit limit. 
+   Senders only need to test for flags once the size check has passed, 
+   since any flagged control value is bigger than a plain size. 
+*/
+
+#define X_ENDPOINT_SIZE_MASK           ((x_transfer_control_t)0x0000FFFF)
+#define X_ENDPOINT_VECTOR_CONTROL      ((x_transfer_control_t)0x80000000)
+#define X_ENDPOINT_SEGMENT_COUNT_SHIFT (16)
+#define X_ENDPOINT_MAX_SEGMENTS        (0x1FFF)
+#define X_ENDPOINT_STRIDED_CONTROL     ((x_transfer_control_t)0x40000000)
+#define X_ENDPOINT_LARGE_CONTROL       ((x_transfer_control_t)0x20000000)
+#define X_ENDPOINT_LARGE_SIZE_MASK     ((x_transfer_control_t)0x1FFFFFFF)
+#define X_ENDPOINT_CONTROL_FLAGS       (X_ENDPOINT_VECTOR_CONTROL  | \
+                                        X_ENDPOINT_STRIDED_CONTROL | \
+                                        X_ENDPOINT_LARGE_CONTROL)
+
+/* The pull flag is set by a sender that wants the receiver to fetch the 
+   data itself - a host task, whose staging buffer in DRAM the receiving
+   core can read by DMA much faster than the host can write to the core.
+   The low 16 bits hold the size and the address is that of the staging
+   buffer. The receiver copies the data and completes the transfer on
+   the sender's behalf, see xtr_pull in x_transfer.c. 
+   Since the flag makes the size look too big for any plain receive 
+   buffer, receivers only need to test for it in that error branch. 
+*/
+
+#define X_ENDPOINT_PULL_CONTROL        ((x_transfer_control_t)0x10000000)
+
 /* Note that the optimal form of this structure uses 32-bit values
    for the sequence, control, and address information.
    The use of 16-bit values (packed or unpacked) significantly slows
    the sync and transfer code. 
 */
 
+/* A data transfer is a single handshake: both peers post their buffer 
+   address, size and sequence number (sequence_from_peer etc.) and once
+   the sender has moved the data it posts the size actually transferred
+   and then the same sequence number to the receiver's completed_from_peer.
+   idle_from_peer is non-zero while the peer is idle waiting for this
+   endpoint, see xc_wake_peer. inline_from_peer is the receive buffer of
+   the inline transfers in x_sync_inline.h - it is doubleword-aligned,
+   so the sender can fill it with one or two doubleword writes. 
+   num_receivers is the number of receivers of a multicast sending 
+   endpoint (copied from its connection at startup), otherwise 1. 
+*/
+
 typedef struct x_endpoint_struct {
 	volatile x_transfer_sequence_t sequence_from_peer;
 	volatile x_transfer_control_t  control_from_peer;
 	volatile x_transfer_address_t  address_from_peer;
+	volatile x_transfer_sequence_t completed_from_peer;
+	volatile x_transfer_control_t  transferred_from_peer;
+	volatile x_transfer_address_t  idle_from_peer;
+	volatile uint64_t              inline_from_peer[2];
         x_transfer_sequence_t          sequence;
         x_endpoint_mode_t              mode;
 	uint16_t                       connection_id;
+	uint16_t                       num_receivers;
         struct x_endpoint_struct      *remote_endpoint;    
+        volatile uint32_t             *doorbell;
+        volatile uint32_t             *peer_doorbell;
 } x_endpoint_t;
 
+/* A buffer_size of zero denotes an ordinary (rendezvous) connection, 
+   otherwise the connection is buffered and this is the size in bytes of
+   the ring buffer in the receiver's local memory. See x_buffered.c.
+
+   A multicast connection is made up of one connection per receiver, 
+   created one after the other so that the sender's endpoints for them
+   are consecutive. The first has the sender's key and multicast set to
+   the number of receivers, the rest have multicast set to -1 and are 
+   only reached through the first. Ordinary connections have multicast 0.
+
+   A connection between two host tasks (other than a multicast one) has a
+   ring in the host shared memory segment, host_ring being its offset from
+   the start of the segment - see x_host_ring.c. It is 0 for all others.
+*/
+
 typedef struct {
 	x_task_id_t     source_task;
 	int             source_key;
 	x_task_id_t     sink_task;
 	int             sink_key;
+	uint32_t        buffer_size;
+	int32_t         multicast;
+	x_memory_offset_t host_ring;
 	x_endpoint_t   *source_endpoint;
 	x_endpoint_t   *sink_endpoint;
 } x_connection_t;
@@ -101,4 +181,126 @@ typedef struct {
 
 extern x_transfer_address_t x_global_address_local_coreid_bits;
 
+/* x_endpoint_doorbell
+
+   A per-task word that peers write after posting to any of the task's 
+   endpoints - see x_wait_any. Each endpoint holds the global address of
+   its own task's doorbell (for the peer to pick up at startup) and the
+   address of the peer's doorbell. 
+   The doorbell is rung after the sequence number is posted, and writes
+   from one core to another arrive in order, so a waiter that clears its
+   doorbell and then finds no endpoint ready is certain to see the 
+   doorbell rung again when a peer becomes ready. 
+
+   x_task_doorbell is the address of the doorbell as seen by the task 
+   itself - that of x_endpoint_doorbell, except in a host task whose 
+   doorbell must be in shared DRAM for the cores to reach it. 
+*/
+
+extern volatile uint32_t  x_endpoint_doorbell;
+extern volatile uint32_t *x_task_doorbell;
+
+/* xc_wake_peer
+
+   A waiting core that has spun for xc_wait_spin_budget iterations 
+   without seeing its peer post sleeps in IDLE, having first put the 
+   global address of its ILATST register in the peer's endpoint 
+   (idle_from_peer). After posting, the peer raises the user interrupt
+   there to wake it. Checking the local word costs the poster a load and
+   a branch, the same whether or not the waiter sleeps.
+   Host tasks never sleep this way and are never woken by interrupt, 
+   see xc_wait_for_peer in x_endpoint.c. 
+*/
+
+#define XC_ILATST_ADDRESS   ((x_transfer_address_t)0x000F042C)
+#define XC_USER_INTERRUPT   ((uint32_t)(1 << 9))
+
+static inline void xc_wake_peer (x_endpoint_t * local_endpoint)
+{
+#ifdef __epiphany__
+    if (local_endpoint->idle_from_peer != 0) {
+        *((volatile uint32_t*)local_endpoint->idle_from_peer) = XC_USER_INTERRUPT;
+    }
+#endif
+}
+
+static inline void xc_ring_doorbell (x_endpoint_t * local_endpoint)
+{
+    *(local_endpoint->peer_doorbell) = 1;
+    xc_wake_peer (local_endpoint);
+}
+
+/* xc_core_endpoint_mode
+
+   TRUE if the endpoint has the given mode and this is an Epiphany task.
+   Used as the mode check of the transfers that address the peer's 
+   buffers directly (vector, strided, large, zero-copy and exchanges), 
+   which a host task cannot do - its endpoints hold Epiphany global 
+   addresses, see xs_host_send in x_sync.c. On the host they therefore
+   fail with X_E_ENDPOINT_MODE_MISMATCH before anything is posted. 
+*/
+
+static inline x_bool_t xc_core_endpoint_mode (x_endpoint_t * local_endpoint,
+                                              x_endpoint_mode_t mode)
+{
+#ifdef __epiphany__
+    return (local_endpoint->mode == mode);
+#else
+    return X_FALSE;
+#endif
+}
+
+/* xc_wait_for_sequence
+
+   Waits until the sequence number in the given word of the local 
+   endpoint reaches the given value. The first test is inline, so that
+   when the peer has already posted the cost is that of the plain spin
+   loop; otherwise xc_wait_for_peer spins and then sleeps, depending on
+   the spin budget set with x_set_wait_spin_budget. 
+   xc_wait_for_progress also returns when the progress word differs from
+   the value seen, see x_sync_receive_large. 
+*/
+
+extern unsigned xc_wait_spin_budget;
+
+void xc_wait_for_peer (x_endpoint_t * local_endpoint, 
+                       volatile x_transfer_sequence_t * word,
+                       x_transfer_sequence_t sequence);
+
+void xc_wait_for_progress (x_endpoint_t * local_endpoint, 
+                           volatile x_transfer_sequence_t * word,
+                           x_transfer_sequence_t sequence,
+                           volatile x_transfer_control_t * progress,
+                           x_transfer_control_t seen);
+
+#ifndef __epiphany__
+void xc_host_backoff (unsigned * polls);
+#endif
+
+static inline void xc_wait_for_sequence (x_endpoint_t * local_endpoint, 
+                                         volatile x_transfer_sequence_t * word,
+                                         x_transfer_sequence_t sequence)
+{
+    if (*word != sequence) {
+        xc_wait_for_peer (local_endpoint, word, sequence);
+    }
+}
+
+/* xc_wait_for_change
+
+   Waits until the given word of the local endpoint no longer holds the
+   value seen, spinning and then sleeping as xc_wait_for_sequence does. 
+   Used by buffered connections, whose ring positions wrap around and so
+   cannot be waited for as sequence numbers. 
+*/
+
+static inline void xc_wait_for_change (x_endpoint_t * local_endpoint, 
+                                       volatile uint32_t * word,
+                                       uint32_t seen)
+{
+    if (*word == seen) {
+        xc_wait_for_progress (local_endpoint, NULL, 0, word, seen);
+    }
+}
+
 #endif /* _X_CONNECTION_INTERNALS_H_ */
@@ -38,4 +38,30 @@ x_endpoint_handle_t x_get_endpoint (int key);
 
 x_bool_t x_endpoint_ready (x_endpoint_handle_t endpoint);
 
+/* Waits until at least one of the given endpoints is ready, and returns
+   its index in the array (or -1 on error). Like the occam ALT, the caller
+   then communicates on the selected endpoint. 
+   The search starts after the endpoint selected last time, so that a 
+   busy endpoint cannot starve the others. 
+*/
+
+int x_wait_any (x_endpoint_handle_t endpoints[], int num_endpoints);
+
+/* Sets how many times a task waiting for its peer in x_sync, x_sync_send,
+   x_sync_receive (and their vector, strided, large and zero-copy forms)
+   polls before it goes to sleep until the peer posts. Zero, the default
+   from x_lib_configuration.h, means poll for ever, which is the fastest
+   way to wait but keeps the core busy. 
+   An Epiphany task sleeps in the IDLE state and is woken by the user
+   interrupt, which this attaches and unmasks. Interrupts are enabled
+   while the task sleeps, and then left as they were before the wait. 
+   Epiphany tasks also wait this way in x_wait_any, unless one of the 
+   peers is a host task. 
+   A host task yields the CPU for a while before it sleeps, and its 
+   budget defaults to X_HOST_WAIT_SPIN_BUDGET. It also waits this way in
+   x_wait_any and on connections to other host tasks. 
+*/
+
+void x_set_wait_spin_budget (unsigned spin_budget);
+
 #endif /* _X_ENDPOINT_H_ */
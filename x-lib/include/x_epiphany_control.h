@@ -92,6 +92,22 @@ x_unmap_epiphany_resources (x_epiphany_control_t * epiphany_control);
 void *
 x_epiphany_to_host_address (x_epiphany_control_t * epiphany_control, 
                             int row, int col, uint32_t epiphany_address);
+
+/*  The reverse of x_epiphany_to_host_address: returns the Epiphany global address
+ *  of a host address within mapped core memory or external memory, or 0 if the 
+ *  host address is not in any of the mapped areas. 
+ */
+
+uint32_t
+x_host_to_epiphany_address (x_epiphany_control_t * epiphany_control, 
+                            const void * host_address);
+
+/*  The Epiphany control structure of the application, set up by 
+ *  x_initialize_application (or, in a host task, at task startup). 
+ */
+
+extern x_epiphany_control_t * x_epiphany_control;
+
 #endif
 
 #endif /* _X_EPIPHANY_CONTROL_H_ */
\ No newline at end of file
@@ -43,6 +43,18 @@ see the files COPYING and COPYING.LESSER. If not, see
 #define X_E_SYNC_TRANSFER_MISMATCH             (-30012)
 #define X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER    (-30013)
 #define X_E_INVALID_TRANSFER_SIZE              (-30014)
+#define X_E_EXCHANGE_LIST_FULL                 (-30015)
+#define X_E_DUPLICATE_EXCHANGE_ENDPOINT        (-30016)
+#define X_E_EMPTY_ENDPOINT_LIST                (-30017)
+#define X_E_INVALID_COLLECTIVE_ROOT            (-30018)
+#define X_E_NOT_A_MESH_TASK                    (-30019)
+#define X_E_INVALID_REDUCTION                  (-30020)
+#define X_E_TOO_MANY_BARRIER_ROUNDS            (-30021)
+#define X_E_NULL_MUTEX                         (-30022)
+#define X_E_MUTEX_NOT_OWNED                    (-30023)
+#define X_E_NEEDS_WRAPAROUND_MESH              (-30024)
+#define X_E_HOST_TASK_ATTACH_FAILED            (-30025)
+#define X_E_MUTEX_NOT_IN_CORE_MEMORY           (-30026)
 
 /* Report an error - the code should be one of the above X-lib error
    codes, or a user-selected negative value between -1 and -29999 
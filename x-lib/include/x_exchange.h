@@ -23,21 +23,55 @@ see the files COPYING and COPYING.LESSER. If not, see
 #define _X_EXCHANGE_H_
 
 /* An exchange is a collection of message passing operations, both
-   sending and receiving of information. 
-   Really useful, but NOT YET IMPLEMENTED! (October 2013). 
+   sending and receiving of information, that are performed together. 
+   The offers for all of the transfers in the list are posted to the
+   peers before any data is moved, and then the transfers are serviced 
+   in whatever order the peers become ready. Thus the cost of the 
+   exchange is roughly that of the slowest peer rather than the sum of
+   all of them, and the order of the elements cannot cause deadlock.
+
+   The peers are free to use x_sync_send and x_sync_receive, or an 
+   exchange of their own - the same protocol is used in all cases. 
+   Exchanges are for Epiphany tasks - in a host task every element fails
+   with X_E_ENDPOINT_MODE_MISMATCH. 
 */
 
 #include <unistd.h>
 #include <x_types.h>
-#include <x_messaging_types.h>
+#include <x_endpoint.h>
+#include <x_sync.h>
+
+/* The state and result fields are maintained by the exchange functions. 
+   After an exchange has completed, the result is the number of bytes
+   transferred or -1 if that element of the exchange failed. 
+   The layout is NULL unless the element was added by 
+   x_add_exchange_strided_element. 
+*/
 
 typedef struct {
 	x_endpoint_handle_t endpoint;
 	void               *buffer;
 	size_t              size;
+	const x_stride_t   *layout;
+	int                 state;
+	int                 result;
 } x_exchange_element_t;
 
-typedef x_exchange_element_t *x_exchange_list_t;
+typedef struct {
+	unsigned             max_entries;
+	unsigned             num_entries;
+	x_exchange_element_t element[];
+} x_exchange_list_header_t;
+
+typedef x_exchange_list_header_t *x_exchange_list_t;
+
+/* Number of bytes needed for an exchange list of the given size, so that
+   it can be allocated on the stack and initialised by x_init_exchange_list.
+*/
+
+#define X_EXCHANGE_LIST_SIZE(_MAX_ENTRIES) \
+            (sizeof(x_exchange_list_header_t) + \
+             (_MAX_ENTRIES)*sizeof(x_exchange_element_t))
 
 /* Management of the exchange lists */
 
@@ -47,10 +81,31 @@ void x_init_exchange_list (x_exchange_list_t exchange_list, unsigned max_entries
 
 x_return_stat_t x_add_exchange_element (x_exchange_list_t exchange_list, x_endpoint_handle_t endpoint, void * buffer, size_t size);
 
-/* Synchronous and asynchronous data exchanges */
+/* Adds a transfer to or from a strided layout, as for x_sync_send_strided
+   and x_sync_receive_strided. The layout must remain valid until the 
+   exchange is done. 
+*/
+
+x_return_stat_t x_add_exchange_strided_element (x_exchange_list_t exchange_list, x_endpoint_handle_t endpoint, const x_stride_t * layout);
+
+/* Synchronous and asynchronous data exchanges 
+
+   x_sync_exchange only returns once all of the transfers in the list
+   have completed. The return value is X_SUCCESS if all of the transfers
+   succeeded, otherwise X_ERROR (the element results show which).
+*/
 
 int x_sync_exchange (x_exchange_list_t exchange_list);
 
+/* x_background_exchange starts all of the transfers in the list, moving
+   data with the DMA engine, and returns at once. x_exchange_done must then
+   be polled until it returns TRUE; it never waits. The buffers must not 
+   be touched, nor the DMA channels used, until the exchange is done. 
+   If an element cannot be offered (a bad endpoint or size) its result is
+   -1 and X_ERROR is returned, but the other transfers have been started
+   and x_exchange_done must still be polled to finish them. 
+*/
+
 int x_background_exchange (x_exchange_list_t exchange_list);
 
 x_bool_t x_exchange_done (x_exchange_list_t exchange_list);
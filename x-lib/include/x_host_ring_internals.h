@@ -0,0 +1,93 @@
+/*
+File: x_host_ring_internals.h
+
+Copyright 2013 Mark Honman
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/* Internal-use functions for connections between two host tasks, which 
+   pass messages through a ring buffer in a POSIX shared memory segment
+   rather than through the XLIB section of the Epiphany's shared DRAM. 
+   The synchronous messaging functions hand over to these when they are
+   given a host ring endpoint, see x_host_ring.c. 
+
+   The same segment holds the application data when there is no Epiphany
+   device, so that host tasks can still be run. 
+*/
+
+#ifndef _X_HOST_RING_INTERNALS_H_
+#define _X_HOST_RING_INTERNALS_H_
+
+#ifndef __epiphany__
+
+#include "x_lib_configuration.h"
+#include "x_types.h"
+#include "x_connection_internals.h"
+#include "x_buffered_internals.h"
+
+/* The shared memory segment is created by x_initialize_application, and 
+   its name passed to host tasks in this environment variable. 
+*/
+
+#define X_HOST_SHM_ENVIRONMENT_VARIABLE "XLIB_SHM_NAME"
+
+/* Host address of the segment - created or attached at startup. 
+*/
+
+extern void * x_host_shared_memory;
+
+void * xhr_create_shared_memory (void);
+
+void * xhr_attach_shared_memory (void);
+
+void xhr_remove_shared_memory (void);
+
+/* Each message in a ring is preceded by its size, see x_host_ring.c. A 
+   connection made by x_connect_tasks gets a ring of X_HOST_RING_SIZE 
+   bytes, or XHR_MIN_DEFAULT_RING_BYTES if that is more, so that any 
+   message that could be sent on another kind of connection fits. 
+*/
+
+typedef uint32_t xhr_record_header_t;
+
+#define XHR_MIN_DEFAULT_RING_BYTES \
+            (XB_RING_BYTES(sizeof(xhr_record_header_t) + X_ENDPOINT_SIZE_MASK))
+#define XHR_DEFAULT_RING_BYTES \
+            ((X_HOST_RING_SIZE > XHR_MIN_DEFAULT_RING_BYTES) ? \
+             X_HOST_RING_SIZE : XHR_MIN_DEFAULT_RING_BYTES)
+
+/* Allocates a ring of the given size in the segment, returning its offset
+   from the start of the segment or 0 if there is no room. 
+*/
+
+x_memory_offset_t xhr_alloc_ring (uint32_t ring_bytes);
+
+void xhr_initialise_endpoint (x_endpoint_t * local_endpoint, 
+                              x_memory_offset_t ring_offset,
+                              x_bool_t sending);
+
+int xhr_send (x_endpoint_t * local_endpoint, const void * buf, 
+              x_transfer_size_t size);
+
+int xhr_receive (x_endpoint_t * local_endpoint, void * buf, 
+                 x_transfer_size_t size);
+
+x_bool_t xhr_ready (x_endpoint_t * local_endpoint);
+
+#endif /* __epiphany__ */
+
+#endif /* _X_HOST_RING_INTERNALS_H_ */
@@ -42,7 +42,67 @@ see the files COPYING and COPYING.LESSER. If not, see
 // Minimum message items for DMA transfers. Due to the effect of aligment
 // on both DMA and non-DMA transfer speeds, it is the number of items
 // rather than the transfer size in bytes that determines the cutoff point.
+// The default cutoffs in bytes for each alignment class are taken from
+// the measurements in e_messaging_test.c. They can be changed at run time
+// with x_set_dma_thresholds, or measured at task startup if 
+// X_MESSAGING_CALIBRATE_DMA is non-zero. 
 #define X_MESSAGING_MIN_DMA_ITEMS (152)
+#define X_MESSAGING_MIN_DMA_BYTES_UNALIGNED   (X_MESSAGING_MIN_DMA_ITEMS)
+#define X_MESSAGING_MIN_DMA_BYTES_WORD        (704)
+#define X_MESSAGING_MIN_DMA_BYTES_DOUBLEWORD  (1408)
+#define X_MESSAGING_CALIBRATE_DMA             (0)
+#define X_DMA_CALIBRATION_BUFFER_SIZE         (2048)
+
+// Number of times a task waiting in x_sync, x_sync_send or x_sync_receive 
+// polls its endpoint before sleeping until the peer posts, see 
+// x_set_wait_spin_budget. Zero polls for ever. 
+#define X_MESSAGING_WAIT_SPIN_BUDGET          (0)
+
+// Host tasks waiting for a peer poll X_HOST_WAIT_SPIN_BUDGET times, then
+// yield the CPU X_HOST_WAIT_YIELDS times, and then sleep - on a futex if 
+// the peer is another host task, or else for periods doubling from 1us
+// up to X_HOST_WAIT_MAX_SLEEP_USECS. 
+#define X_HOST_WAIT_SPIN_BUDGET               (2000)
+#define X_HOST_WAIT_YIELDS                    (32)
+#define X_HOST_WAIT_MAX_SLEEP_USECS           (200)
+
+// Number of DMA channels per Epiphany core
+#define X_DMA_CHANNELS (2)
+
+// Large transfers (x_sync_send_large) are copied in chunks of this size,
+// the receiver being told of progress after each chunk. 
+#define X_LARGE_TRANSFER_CHUNK_SIZE (4096)
+
+// Collective operations (x_collective.h) are pipelined through the mesh
+// in segments of this size. The reductions need a segment-sized buffer
+// on the stack. 
+#define X_COLLECTIVE_SEGMENT_SIZE (1024)
+
+// x_barrier takes log2(number of cores) rounds, each with its own flag
+// word in every core. 
+#define X_BARRIER_MAX_ROUNDS (12)
+
+// Most receivers of a multicast connection. x_sync_send on a multicast
+// connection builds an exchange list of this size on the stack. 
+#define X_MULTICAST_MAX_RECEIVERS (16)
+
+// Range of the delays (in busy-wait loop iterations) between attempts to
+// take a contended mutex with the X_MUTEX_BACKOFF option. 
+#define X_MUTEX_MIN_BACKOFF (16)
+#define X_MUTEX_MAX_BACKOFF (4096)
+
+// Host tasks have their endpoints in the XLIB section of shared DRAM,
+// after the application data, with a staging buffer per endpoint that
+// holds the largest plain transfer. 
+#define X_HOST_STAGING_SIZE (0x10000)
+
+// Connections between two host tasks pass messages through a ring of this
+// size (unless buffered with a size of their own, and never smaller than
+// the largest message needs - see x_host_ring_internals.h) in a POSIX shared memory
+// segment. The segment also has room for a copy of the XLIB section, used
+// for the application data when there is no Epiphany device. 
+#define X_HOST_RING_SIZE      (0x10000)
+#define X_HOST_RING_AREA_SIZE (0x00400000)
 
 // NB! The following must match the HDF and LDF in use. 
 // In fact the information can probably be obtained from the LDF
@@ -61,5 +121,6 @@ see the files COPYING and COPYING.LESSER. If not, see
 #define X_HOST_PROCESS_SHARED_DRAM_BASE  (0x00000000)
 #define X_EPIPHANY_SHARED_DRAM_BASE      (0x8e000000)
 #define X_LIB_SECTION_OFFSET             (0x00800000)
+#define X_LIB_SECTION_SIZE               (0x00800000)
 
 #endif /* _X_LIB_CONFIGURATION_H_ */
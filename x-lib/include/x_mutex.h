@@ -0,0 +1,61 @@
+/*
+File: x_mutex.h
+
+Copyright 2013 Mark Honman
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _X_MUTEX_H_
+#define _X_MUTEX_H_
+
+/* Mutual exclusion between tasks, using a word in core memory or shared
+   DRAM that is visible to all of the contending tasks. 
+   
+   Epiphany tasks use the TESTSET instruction, host tasks use C11 atomic
+   operations. The two do not interlock with each other, so a mutex must
+   be shared by Epiphany tasks only or by host tasks only. The Epiphany
+   TESTSET only works on core memory, so on the Epiphany x_mutex_lock 
+   fails (X_E_MUTEX_NOT_IN_CORE_MEMORY) on a mutex in shared DRAM. 
+   
+   A mutex word is zero when free, otherwise it holds the owner's task 
+   ID plus one. While waiting for a mutex, the task state is 
+   X_MUTEX_WAITING_TASK. 
+*/
+
+#include <stdint.h>
+#include <x_types.h>
+
+typedef volatile uint32_t x_mutex_t;
+
+/* Options for x_mutex_lock. 
+   With X_MUTEX_BACKOFF, a waiting task delays between attempts for 
+   exponentially increasing periods (up to X_MUTEX_MAX_BACKOFF cycles), 
+   so that heavily contended locks do not flood the mesh with reads. 
+   A waiting host task always backs off from polling to yielding the CPU
+   and sleeping, as in its other waits (see x_set_wait_spin_budget). 
+*/
+
+#define X_MUTEX_SPIN    (0)
+#define X_MUTEX_BACKOFF (1)
+
+void x_mutex_init (x_mutex_t *mutex);
+
+x_return_stat_t x_mutex_lock (x_mutex_t *mutex, int options);
+
+x_return_stat_t x_mutex_unlock (x_mutex_t *mutex);
+
+#endif /* _X_MUTEX_H_ */
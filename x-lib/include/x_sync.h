@@ -54,8 +54,117 @@ int x_sync_send (x_endpoint_handle_t endpoint, const void * buf, x_transfer_size
    sized buffer. 
 
    The return value is the number of bytes received, or -1 on error. 
+   For messages of 4, 8 or 16 bytes, see also the inline forms in 
+   x_sync_inline.h. 
 */
 
 int x_sync_receive (x_endpoint_handle_t endpoint, void * buf, x_transfer_size_t size);
 
+/* Scatter/gather forms of x_sync_send and x_sync_receive, moving data 
+   from several source segments into several destination segments with
+   a single synchronisation. Either side of a connection can use the 
+   plain or the vector form, and the segments need not match up. 
+   The segments together may not exceed the maximum transfer size, and 
+   a receiver may have at most 8191 segments. 
+   The return value is the total number of bytes transferred, or -1 on
+   error. Not supported on buffered connections, nor in host tasks. 
+*/
+
+typedef struct {
+        void              *base;
+        x_transfer_size_t  size;
+} x_iovec_t;
+
+int x_sync_sendv (x_endpoint_handle_t endpoint, const x_iovec_t * iov, int iovcnt);
+
+int x_sync_receivev (x_endpoint_handle_t endpoint, const x_iovec_t * iov, int iovcnt);
+
+/* Strided forms of x_sync_send and x_sync_receive, for moving tiles and
+   columns of matrices under a single synchronisation. A layout is 
+   outer_count rows of inner_count elements of element_size bytes, the
+   strides being the distances in bytes between the starts of successive
+   elements in a row and of successive rows. For example column c of a 
+   float m[32][32] is { &m[0][c], 4, 1, 4, 32, 128 }.
+   The peer may use a strided, plain or (vector senders excepted) vector 
+   call - only the total sizes need agree. When both layouts have the 
+   same shape and are suitably aligned the transfer is done by the DMA
+   engine using its stride registers. 
+   The layout must remain valid until the call returns. 
+   Not supported in host tasks. 
+*/
+
+typedef struct {
+        void     *base;
+        uint16_t  element_size;
+        uint16_t  inner_count;
+        int32_t   inner_stride;
+        uint16_t  outer_count;
+        int32_t   outer_stride;
+} x_stride_t;
+
+int x_sync_send_strided (x_endpoint_handle_t endpoint, const x_stride_t * layout);
+
+int x_sync_receive_strided (x_endpoint_handle_t endpoint, const x_stride_t * layout);
+
+/* Zero-copy sending. x_acquire_send_buffer waits for the peer to call
+   x_sync_receive, and returns a pointer to the peer's receive buffer
+   (NULL on error) provided that it can hold size bytes. The sender then
+   builds the message directly in that buffer, and x_commit_send 
+   completes the transfer, giving the number of bytes actually written.
+   x_commit_send returns that size, or -1 on error. 
+   Every successful acquire must be followed by a commit. 
+   Not supported in host tasks. 
+*/
+
+void * x_acquire_send_buffer (x_endpoint_handle_t endpoint, x_transfer_size_t size);
+
+int x_commit_send (x_endpoint_handle_t endpoint, x_transfer_size_t size);
+
+/* Large transfers, of up to 512MB. The data are copied in chunks of
+   X_LARGE_TRANSFER_CHUNK_SIZE bytes, and after each chunk arrives the 
+   receiver's chunk handler (if not NULL) is called with the address and 
+   size of the newly arrived data - so that the receiver can work on one
+   chunk while the next is in transit. 
+   The receiver may be paired with any of the other send calls, but the 
+   sender requires a receiver using x_sync_receive_large. 
+   The return value is the total number of bytes transferred, or -1 on
+   error. Not supported on buffered connections, nor in host tasks. 
+*/
+
+typedef void (*x_chunk_handler_t) (void * chunk, size_t chunk_size, void * context);
+
+int x_sync_send_large (x_endpoint_handle_t endpoint, const void * buf, size_t size);
+
+int x_sync_receive_large (x_endpoint_handle_t endpoint, void * buf, size_t size,
+                          x_chunk_handler_t handler, void * context);
+
+/* Non-blocking variants of x_sync_send and x_sync_receive. If the peer has
+   already posted its side of the transfer (or for a buffered connection,
+   there is room in the ring or a message waiting) the transfer is done 
+   and the result is as for the blocking call. Otherwise X_WOULD_BLOCK is
+   returned and nothing is posted to the peer, so the call can simply be
+   repeated later. 
+*/
+
+#define X_WOULD_BLOCK (X_WARNING)
+
+int x_try_send (x_endpoint_handle_t endpoint, const void * buf, x_transfer_size_t size);
+
+int x_try_receive (x_endpoint_handle_t endpoint, void * buf, x_transfer_size_t size);
+
+/* Large transfers are done by the DMA engine of the Epiphany core, the 
+   cutoff point depending on the alignment of the buffers. The default
+   thresholds are in x_lib_configuration.h.
+   x_set_dma_thresholds sets the minimum sizes in bytes for which DMA is
+   used (zero leaves a threshold unchanged).
+   x_calibrate_dma_thresholds measures the crossover points on the 
+   running core - it is called at startup if X_MESSAGING_CALIBRATE_DMA 
+   is non-zero. It returns X_WARNING on the host, which has no DMA engine.
+*/
+
+void x_set_dma_thresholds (size_t unaligned, size_t word_aligned, 
+                           size_t doubleword_aligned);
+
+x_return_stat_t x_calibrate_dma_thresholds (void);
+
 #endif /* _X_SYNC_H_ */
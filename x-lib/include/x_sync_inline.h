@@ -0,0 +1,223 @@
+/*
+File: x_sync_inline.h
+
+Copyright 2013 Mark Honman
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/* Inline forms of x_sync_send and x_sync_receive for messages of 4, 8 
+   or 16 bytes - scalars, pairs and small structures. 
+
+   The call-and-return overhead is about half the cost of a minimal
+   x_sync, and a small x_sync_send also pays for the general copy logic
+   (see the timings in e_messaging_test.c). These forms are expanded in
+   line and, when the size is a constant, the data are moved by one to 
+   four loads and stores, with no copy loop. 
+
+   The handshake is that of x_sync_send and x_sync_receive, so either
+   peer may use the inline or the ordinary form. An inline receiver 
+   offers the inline buffer in its endpoint rather than the caller's 
+   buffer, and copies the message from there - so a sender writes into a
+   doubleword-aligned buffer in core memory whatever the alignment of
+   the receiver's buffer. 
+
+   Restrictions:
+    * buf must be word-aligned. 
+    * The receiver copies size bytes to buf even if the sender sent 
+      fewer - the result is the size actually sent, as for x_sync_receive.
+    * Other sizes, other kinds of connection, and host tasks use the 
+      ordinary functions. 
+*/
+
+#ifndef _X_SYNC_INLINE_H_
+#define _X_SYNC_INLINE_H_
+
+#include <stdint.h>
+#include "x_types.h"
+#include "x_error.h"
+#include "x_endpoint.h"
+#include "x_sync.h"
+#include "x_connection_internals.h"
+#include "x_transfer_internals.h"
+
+#define X_INLINE_TRANSFER_SIZE(_SIZE) \
+            (((_SIZE) == 4) || ((_SIZE) == 8) || ((_SIZE) == 16))
+
+/* The rest of the handshake when the peer's offer is not a plain one, 
+   see x_sync.c. 
+*/
+
+int xs_inline_send_offered (x_endpoint_t * local_endpoint, const void * buf, 
+                            x_transfer_size_t size, 
+                            x_transfer_sequence_t new_sequence);
+
+int xs_inline_receive_offered (x_endpoint_t * local_endpoint, 
+                               x_transfer_size_t receive_size, void * buf,
+                               x_transfer_sequence_t new_sequence);
+
+#ifdef __epiphany__
+
+/* xs_inline_store
+   xs_inline_load
+
+  Copy 4, 8 or 16 bytes from the sender's word-aligned buffer to the
+  receiver's buffer, which is doubleword-aligned for the 8 and 16 byte
+  sizes - by word loads and doubleword stores, so that a remote buffer
+  takes one write per doubleword. And from the inline buffer to the 
+  receiver's word-aligned buffer, by words. 
+*/
+
+static inline void xs_inline_store (void * dest, const void * src, 
+                                    x_transfer_size_t size)
+{
+    const uint32_t *word = (const uint32_t*)src;
+    union { uint64_t doubleword; uint32_t word[2]; } value;
+
+    if (size == 4) {
+        *((uint32_t*)dest) = word[0];
+        return;
+    }
+    value.word[0] = word[0];
+    value.word[1] = word[1];
+    *((uint64_t*)dest) = value.doubleword;
+    if (size == 16) {
+        value.word[0] = word[2];
+        value.word[1] = word[3];
+        *((uint64_t*)dest + 1) = value.doubleword;
+    }
+}
+
+static inline void xs_inline_load (void * dest, const volatile uint64_t * src,
+                                   x_transfer_size_t size)
+{
+    const volatile uint32_t *word = (const volatile uint32_t*)src;
+
+    ((uint32_t*)dest)[0] = word[0];
+    if (size >= 8) {
+        ((uint32_t*)dest)[1] = word[1];
+    }
+    if (size == 16) {
+        ((uint32_t*)dest)[2] = word[2];
+        ((uint32_t*)dest)[3] = word[3];
+    }
+}
+
+#endif /* __epiphany__ */
+
+/* x_sync_send_inline
+
+  Algorithm:
+    As xs_send (x_sync.c), except that if the receiver offers a plain 
+    buffer that is big enough and suitably aligned, the data are stored
+    straight into it and the completion posted here. Anything else is
+    passed to xs_inline_send_offered, which handles it as x_sync_send 
+    would. 
+*/
+
+static inline int x_sync_send_inline (x_endpoint_handle_t endpoint, 
+                                      const void * buf, x_transfer_size_t size)
+{
+#ifdef __epiphany__
+    x_endpoint_t                  *local_endpoint  = (x_endpoint_t*) endpoint;
+    x_endpoint_t                  *remote_endpoint = local_endpoint->remote_endpoint;
+    register x_transfer_sequence_t new_sequence = (local_endpoint->sequence + 1);
+    x_transfer_control_t           size_from_peer;
+    x_transfer_address_t           dest;
+
+    if ((local_endpoint->mode != X_SENDING_ENDPOINT) || 
+        !X_INLINE_TRANSFER_SIZE(size)) {
+        return x_sync_send (endpoint, buf, size);
+    }
+    remote_endpoint->address_from_peer  = xtr_global_address (buf);
+    remote_endpoint->control_from_peer  = size;
+    remote_endpoint->sequence_from_peer = new_sequence;
+    xc_ring_doorbell (local_endpoint);
+
+    xc_wait_for_sequence (local_endpoint, &local_endpoint->sequence_from_peer, new_sequence);
+    size_from_peer = local_endpoint->control_from_peer;
+    dest           = local_endpoint->address_from_peer;
+    if ((size_from_peer < size) || (size_from_peer > X_ENDPOINT_SIZE_MASK) ||
+        (dest & ((size == 4) ? 0x3 : 0x7))) {
+        return xs_inline_send_offered (local_endpoint, buf, size, new_sequence);
+    }
+    local_endpoint->sequence = new_sequence;
+    xs_inline_store ((void*)dest, buf, size);
+    remote_endpoint->transferred_from_peer = size;
+    remote_endpoint->completed_from_peer   = new_sequence;
+    xc_wake_peer (local_endpoint);
+    return size;
+#else
+    return x_sync_send (endpoint, buf, size);
+#endif
+}
+
+/* x_sync_receive_inline
+
+  Algorithm:
+    As xs_receive (x_sync.c), offering the endpoint's inline buffer. If 
+    the sender's offer is a plain one that fits, wait for the completion
+    here, otherwise pass the offer to xs_inline_receive_offered. Then 
+    copy the message from the inline buffer to buf. 
+*/
+
+static inline int x_sync_receive_inline (x_endpoint_handle_t endpoint, 
+                                         void * buf, x_transfer_size_t size)
+{
+#ifdef __epiphany__
+    x_endpoint_t                  *local_endpoint  = (x_endpoint_t*) endpoint;
+    x_endpoint_t                  *remote_endpoint = local_endpoint->remote_endpoint;
+    register x_transfer_sequence_t new_sequence = (local_endpoint->sequence + 1);
+    x_transfer_control_t           size_from_peer;
+    int                            result;
+
+    if ((local_endpoint->mode != X_RECEIVING_ENDPOINT) || 
+        !X_INLINE_TRANSFER_SIZE(size)) {
+        return x_sync_receive (endpoint, buf, size);
+    }
+    remote_endpoint->address_from_peer  = 
+        xtr_global_address ((void*)local_endpoint->inline_from_peer);
+    remote_endpoint->control_from_peer  = size;
+    remote_endpoint->sequence_from_peer = new_sequence;
+    xc_ring_doorbell (local_endpoint);
+
+    xc_wait_for_sequence (local_endpoint, &local_endpoint->sequence_from_peer, new_sequence);
+    size_from_peer = local_endpoint->control_from_peer;
+    if (((size_from_peer != X_ENDPOINT_SYNC_CONTROL) && (size_from_peer <= size)) ||
+        (local_endpoint->completed_from_peer == new_sequence)) {
+        xc_wait_for_sequence (local_endpoint, &local_endpoint->completed_from_peer, new_sequence);
+        local_endpoint->sequence = new_sequence;
+        result = local_endpoint->transferred_from_peer;
+        if (result == X_ENDPOINT_SYNC_CONTROL) {
+            return x_error (X_E_SYNC_TRANSFER_MISMATCH, result, endpoint);
+        }
+    }
+    else {
+        result = xs_inline_receive_offered (local_endpoint, size, 
+                                            (void*)local_endpoint->inline_from_peer,
+                                            new_sequence);
+        if (result < 0) {
+            return result;
+        }
+    }
+    xs_inline_load (buf, local_endpoint->inline_from_peer, size);
+    return result;
+#else
+    return x_sync_receive (endpoint, buf, size);
+#endif
+}
+
+#endif /* _X_SYNC_INLINE_H_ */
@@ -0,0 +1,288 @@
+/*
+File: x_transfer_internals.h
+
+Copyright 2013 Mark Honman
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/* Internal-use data transfer building blocks shared by the synchronous
+   messaging functions and the exchange functions.
+
+   These are static inline because the call-and-return overhead (12-15
+   cycles) is a significant part of the cost of a small transfer, see
+   the timings in e_messaging_test.c.
+*/
+
+#ifndef _X_TRANSFER_INTERNALS_H_
+#define _X_TRANSFER_INTERNALS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "x_lib_configuration.h"
+#include "x_types.h"
+#include "x_sync.h"
+#include "x_connection_internals.h"
+
+/* xtr_global_address
+
+  Converts a buffer address into the form that is passed to the peer.
+  Core-local addresses (top 12 bits zero) have the local coreid bits
+  masked in, other addresses are already global.
+  It is slightly faster to test whether an address is global by shifting
+  it right 20 bits, than using a bitmask.
+*/
+
+static inline x_transfer_address_t xtr_global_address (const void * buf)
+{
+    if ((((x_transfer_address_t)buf) >> 20) == 0) {
+        return ((x_transfer_address_t)buf) | x_global_address_local_coreid_bits;
+    }
+    else {
+        return (x_transfer_address_t)buf;
+    }
+}
+
+/* xtr_copy
+
+  Data transfer (copying) logic - the reasoning
+    * Epiphany multibyte load/store instructions require that data be aligned
+      in memory according to data size.
+    * For sub-optimal start and end offsets, it is possible to ramp up to
+      doubleword transfers, and ramp down at the end.
+    * When the source and destination addresses have different alignments,
+      this limits the biggest load/store operation size.
+
+  Data copying algorithm:
+    Since there are a lot of cases to check, the tests are structured to
+    favour the most common case, word-aligned data (which may turn out to be
+    doubleword-aligned, but due to the absence of double precision floating
+    point support, naturally doubleword-aligned data are rare).
+    Doing too many tests increases the overhead, limiting the benefits of
+    special-case coding.
+
+    If send and receive buffers are word-aligned
+       If size is >= 32, a doubleword transfer is worthwhile
+         If the destination address is not doubleword-aligned
+           Copy the first word
+         If both buffers have the same even or odd word alignment
+           while size remaining >= 32
+             Copy double words in a 4x unrolled loop
+         Else
+           while size remaining >= 16
+             Load pairs of words and store them as double words, in a 
+             2x unrolled loop
+       while size remaining >= 16
+           Copy words in a 4x unrolled loop
+       while size remaining >= 4
+           Copy a word
+       for size remaining
+           Copy a byte
+    Else if size >= XTR_MIN_MISALIGNED_COPY
+      Use the shift-and-merge copy, xtr_copy_misaligned in x_transfer.c
+    Else (buffers not word-aligned, short transfer)
+      While size remaining >= 8
+         Copy bytes in an 8x unrolled loop
+      for size remaining
+         copy a byte
+
+  Storing the destination by double words matters most when it is in
+  another core, since each store is then a write transaction on the mesh.
+*/
+
+#define XTR_MIN_MISALIGNED_COPY (16)
+
+void xtr_copy_misaligned (void * dest, const void * src, size_t size);
+
+
+static inline void xtr_copy (void * dest, const void * src, size_t size)
+{
+    register char * src_ptr  = (char*)src;
+    register char * dest_ptr = (char*)dest;
+    register char * after_end_ptr  = dest_ptr + size;
+    if ((((uint32_t)src_ptr | (uint32_t)dest_ptr) & 0x3) == 0) {
+        // Word-aligned happy zone, maybe doubleword transfers can be done
+        if (size >= 32) {
+            if ((uint32_t)dest_ptr & 0x4) {
+                *((uint32_t*)dest_ptr) = *((uint32_t*)src_ptr);
+                src_ptr  += 4;
+                dest_ptr += 4;
+            }
+            if (((uint32_t)src_ptr & 0x4) == 0) {
+                while (after_end_ptr - dest_ptr >= 32) {
+                    *((uint64_t*)dest_ptr)   = *((uint64_t*)src_ptr);
+                    *((uint64_t*)dest_ptr+1) = *((uint64_t*)src_ptr+1);
+                    *((uint64_t*)dest_ptr+2) = *((uint64_t*)src_ptr+2);
+                    *((uint64_t*)dest_ptr+3) = *((uint64_t*)src_ptr+3);
+                    src_ptr  += 32;
+                    dest_ptr += 32;
+                }
+            }
+            else {
+                union { uint64_t doubleword; uint32_t word[2]; } low, high;
+                while (after_end_ptr - dest_ptr >= 16) {
+                    low.word[0]  = *((uint32_t*)src_ptr);
+                    low.word[1]  = *((uint32_t*)src_ptr+1);
+                    high.word[0] = *((uint32_t*)src_ptr+2);
+                    high.word[1] = *((uint32_t*)src_ptr+3);
+                    *((uint64_t*)dest_ptr)   = low.doubleword;
+                    *((uint64_t*)dest_ptr+1) = high.doubleword;
+                    src_ptr  += 16;
+                    dest_ptr += 16;
+                }
+            }
+        }
+        while (after_end_ptr - dest_ptr >= 16) {
+            *((uint32_t*)dest_ptr)   = *((uint32_t*)src_ptr);
+            *((uint32_t*)dest_ptr+1) = *((uint32_t*)src_ptr+1);
+            *((uint32_t*)dest_ptr+2) = *((uint32_t*)src_ptr+2);
+            *((uint32_t*)dest_ptr+3) = *((uint32_t*)src_ptr+3);
+            src_ptr  += 16;
+            dest_ptr += 16;
+        }
+        while (after_end_ptr - dest_ptr >= 4) {
+            *((uint32_t*)dest_ptr) = *((uint32_t*)src_ptr);
+            src_ptr  += 4;
+            dest_ptr += 4;
+        }
+        while (after_end_ptr - dest_ptr >= 1) {
+            *dest_ptr++ = *src_ptr++;
+        }
+    }
+    else if (size >= XTR_MIN_MISALIGNED_COPY) {
+        xtr_copy_misaligned (dest, src, size);
+    }
+    else {
+        // not word-aligned and short, do the best possible with bytewise copy
+        while (after_end_ptr - dest_ptr >= 8) {
+            *dest_ptr++ = *src_ptr++;
+            *dest_ptr++ = *src_ptr++;
+            *dest_ptr++ = *src_ptr++;
+            *dest_ptr++ = *src_ptr++;
+            *dest_ptr++ = *src_ptr++;
+            *dest_ptr++ = *src_ptr++;
+            *dest_ptr++ = *src_ptr++;
+            *dest_ptr++ = *src_ptr++;
+        }
+        while (after_end_ptr - dest_ptr >= 1) {
+            *dest_ptr++ = *src_ptr++;
+        }
+    }
+}
+
+/* DMA engine control (Epiphany only) - see x_transfer.c.
+   Channels are numbered 0 and 1, matching E_DMA_0 and E_DMA_1, and
+   must be acquired before use. 
+*/
+
+#ifdef __epiphany__
+
+int xtr_dma_acquire (void * owner);
+
+void xtr_dma_release (int channel);
+
+int xtr_dma_channel_of (void * owner);
+
+x_return_stat_t xtr_dma_start (int channel, void * dest, const void * src, 
+                               size_t size);
+
+x_return_stat_t xtr_dma_start_2d (int channel, void * dest, const void * src,
+                                  unsigned width, 
+                                  unsigned inner_count, unsigned outer_count,
+                                  int src_inner_stride, int dest_inner_stride,
+                                  int src_outer_stride, int dest_outer_stride);
+
+x_bool_t xtr_dma_busy (int channel);
+
+void xtr_dma_copy (void * dest, const void * src, size_t size);
+
+#endif /* __epiphany__ */
+
+/* DMA thresholds, by alignment class of the source and destination 
+   addresses. See x_set_dma_thresholds in x_sync.h. 
+*/
+
+#define X_DMA_UNALIGNED          (0)
+#define X_DMA_WORD_ALIGNED       (1)
+#define X_DMA_DOUBLEWORD_ALIGNED (2)
+#define X_DMA_ALIGNMENT_CLASSES  (3)
+
+extern size_t xtr_dma_threshold[X_DMA_ALIGNMENT_CLASSES];
+extern size_t xtr_dma_threshold_min;
+
+/* xtr_transfer
+
+  Copies data to the peer, using the DMA engine if the transfer is large
+  enough for this to be faster than a CPU copy. The test against the
+  smallest threshold keeps the cost for small transfers to one compare. 
+*/
+
+static inline void xtr_transfer (void * dest, const void * src, size_t size)
+{
+#ifdef __epiphany__
+    uint32_t alignment;
+    int      alignment_class;
+
+    if (size >= xtr_dma_threshold_min) {
+        alignment = (uint32_t)dest | (uint32_t)src;
+        alignment_class = ((alignment & 0x7) == 0) ? X_DMA_DOUBLEWORD_ALIGNED :
+                          ((alignment & 0x3) == 0) ? X_DMA_WORD_ALIGNED :
+                                                     X_DMA_UNALIGNED;
+        if (size >= xtr_dma_threshold[alignment_class]) {
+            xtr_dma_copy (dest, src, size);
+            return;
+        }
+    }
+#endif
+    xtr_copy (dest, src, size);
+}
+
+/* xtr_vector_transfer
+   xtr_strided_transfer
+   xtr_special_transfer
+
+  Copy to a receiver from a source that is not a simple buffer, or to
+  a receiver whose control word has flags set - see x_transfer.c. 
+  xtr_special_transfer chooses between the other two. 
+  Return the size transferred or -1. 
+*/
+
+int xtr_vector_transfer (const x_iovec_t * source, int source_count,
+                         x_transfer_size_t size,
+                         x_transfer_address_t dest_address,
+                         x_transfer_control_t dest_control);
+
+int xtr_strided_transfer (const x_stride_t * source_layout, const void * buf,
+                          x_transfer_size_t size,
+                          x_transfer_address_t dest_address,
+                          x_transfer_control_t dest_control);
+
+int xtr_special_transfer (const void * buf, x_transfer_size_t size,
+                          const x_iovec_t * iov, int iovcnt,
+                          const x_stride_t * layout,
+                          x_transfer_address_t dest_address,
+                          x_transfer_control_t dest_control);
+
+/* xtr_pull
+
+  Receiver side of a transfer from a sender that has set the pull flag,
+  see x_transfer.c. Returns the size transferred. 
+*/
+
+int xtr_pull (x_endpoint_t * local_endpoint, void * buf, x_transfer_size_t size,
+              x_transfer_sequence_t sequence);
+
+#endif /* _X_TRANSFER_INTERNALS_H_ */
@@ -0,0 +1,120 @@
+/*
+File: x_address.c
+
+Copyright 2013 Mark Honman
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/* Conversion between host and Epiphany addresses.
+
+   On the host side the conversions use the mappings of core memory and
+   of the external memory segments made by x_map_epiphany_resources, so
+   they only work once the application (or, in a host task, the task)
+   has been initialised.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include "x_lib_configuration.h"
+#include "x_types.h"
+#include "x_address.h"
+
+#ifdef __epiphany__
+
+void * x_host_to_epiphany_shared_memory_address (void * host_shared_memory_address)
+{
+    return host_shared_memory_address;
+}
+
+void * x_epiphany_to_host_shared_memory_address (void * epiphany_shared_memory_address)
+{
+    return epiphany_shared_memory_address;
+}
+
+#else
+
+#include "x_epiphany_control.h"
+#include "x_application_internals.h"
+
+#define XA_LIB_SECTION_BASE (X_EPIPHANY_SHARED_DRAM_BASE + X_LIB_SECTION_OFFSET)
+
+/* x_host_to_epiphany_shared_memory_address
+   x_epiphany_to_host_shared_memory_address
+
+  Convert between the host process and Epiphany addresses of data in the
+  shared DRAM.
+
+  When there is no Epiphany device the application data are in the host
+  shared memory segment instead (see x_host_ring.c), which is mapped at
+  a different address in each process. Addresses in it are then given 
+  the Epiphany addresses that they would have in the XLIB section, so 
+  that they have the same meaning in every process. 
+*/
+
+void * x_host_to_epiphany_shared_memory_address (void * host_shared_memory_address)
+{
+    char *address = (char*)host_shared_memory_address;
+
+    if (address == NULL) {
+        return NULL;
+    }
+    if (x_epiphany_control == NULL) {
+        if ((x_application == NULL) || (address < (char*)x_application) ||
+            (address >= (char*)x_application + X_LIB_SECTION_SIZE)) {
+            return NULL;
+        }
+        return (void*)(uintptr_t)
+               (XA_LIB_SECTION_BASE + (address - (char*)x_application));
+    }
+    return (void*)(uintptr_t)
+           x_host_to_epiphany_address (x_epiphany_control, address);
+}
+
+void * x_epiphany_to_host_shared_memory_address (void * epiphany_shared_memory_address)
+{
+    uint32_t address = (uint32_t)(uintptr_t)epiphany_shared_memory_address;
+
+    if (x_epiphany_control == NULL) {
+        if ((x_application == NULL) || (address < XA_LIB_SECTION_BASE) ||
+            (address >= XA_LIB_SECTION_BASE + X_LIB_SECTION_SIZE)) {
+            return NULL;
+        }
+        return (char*)x_application + (address - XA_LIB_SECTION_BASE);
+    }
+    return x_epiphany_to_host_address (x_epiphany_control, 0, 0, address);
+}
+
+/* x_epiphany_core_memory_to_host_mapped_address
+   x_host_mapped_to_epiphany_core_memory_address
+
+  Convert between the global Epiphany address of data in core memory and
+  the address at which that memory is mapped into the host process.
+  The Epiphany address must be global (include the coreid), since the
+  host is not any particular core.
+*/
+
+void * x_epiphany_core_memory_to_host_mapped_address (void * epiphany_address)
+{
+    return x_epiphany_to_host_shared_memory_address (epiphany_address);
+}
+
+void * x_host_mapped_to_epiphany_core_memory_address (void * host_mapped_core_address)
+{
+    return x_host_to_epiphany_shared_memory_address (host_mapped_core_address);
+}
+
+#endif /* __epiphany__ */
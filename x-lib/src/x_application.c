@@ -28,6 +28,8 @@ see the files COPYING and COPYING.LESSER. If not, see
 #include "x_application.h"
 #include "x_application_internals.h"
 #include "x_application_display.h"
+#include "x_buffered_internals.h"
+#include "x_host_ring_internals.h"
 
 /*=================== APPLICATION DATA STRUCTURES =====================*/
 
@@ -131,6 +133,7 @@ x_task_descriptor_t * x_task_id_descriptor (x_task_id_t id)
             result = task_descriptor_table + id; 		  
         }	  
     }
+    return result;
 }
 
 /*------------------ EXTERNALLY VISIBLE FUNCTIONS --------------------*/
@@ -283,6 +286,7 @@ x_is_host_task (x_task_id_t task_id)
 
 #include <unistd.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 
 /*------------------------ INTERNAL FUNCTIONS --------------------------*/
@@ -450,6 +454,14 @@ int xc_master_elements_allocated = 0;
 int xc_master_elements_used      = 0;
 x_connection_t * xc_master_connection_list = NULL;
 
+/* Once the connections have been copied to shared memory (when the first
+   task is launched) no more can be made. xc_connections_published is 
+   set then, and xc_connection_setup_result records the outcome. 
+*/
+
+x_bool_t        xc_connections_published   = X_FALSE;
+x_return_stat_t xc_connection_setup_result = X_ERROR;
+
 xc_task_connection_lookup_t **xc_task_connection_index = NULL;
 
 /*  xc_connect_by_task_id
@@ -616,13 +628,19 @@ xc_add_task_endpoint (x_task_id_t task_id,
 
 static x_return_stat_t 
 xc_connect_by_task_id (x_task_id_t sender,   int sender_key,
-                       x_task_id_t receiver, int receiver_key)
+                       x_task_id_t receiver, int receiver_key,
+                       uint32_t    buffer_size,
+                       int32_t     multicast)
 {
     x_return_stat_t result = X_ERROR;
     int             index;
                 
-    if ((0 == xc_validate_task_key (sender, sender_key, XC_SOURCE, "sending",
-                                    &xc_task_connection_index)) &&
+    if (xc_connections_published) {
+        printf ("Connect Tasks: connections cannot be made once tasks have been launched\n");
+    }
+    else if (((multicast < 0) ||
+         (0 == xc_validate_task_key (sender, sender_key, XC_SOURCE, "sending",
+                                     &xc_task_connection_index))) &&
         (0 == xc_validate_task_key (receiver, receiver_key, XC_SINK, "receiving",
                                     &xc_task_connection_index))) {
                                                 
@@ -652,6 +670,9 @@ xc_connect_by_task_id (x_task_id_t sender,   int sender_key,
             xc_master_connection_list[index].source_key      = sender_key;
             xc_master_connection_list[index].sink_task       = receiver;
             xc_master_connection_list[index].sink_key        = receiver_key;
+            xc_master_connection_list[index].buffer_size     = buffer_size;
+            xc_master_connection_list[index].multicast       = multicast;
+            xc_master_connection_list[index].host_ring       = 0;
             xc_master_connection_list[index].source_endpoint = NULL;
             xc_master_connection_list[index].sink_endpoint   = NULL;
             if ((0 != xc_add_task_endpoint (sender, &xc_task_connection_index,
@@ -694,7 +715,7 @@ x_return_stat_t xc_connect_by_workgroup_coords
                                                wrapped_receiver_column);
 
     result = xc_connect_by_task_id (sender_task_id,   sender_key, 
-                                    receiver_task_id, receiver_key);
+                                    receiver_task_id, receiver_key, 0, 0);
                                         
     return result;
 }
@@ -716,6 +737,10 @@ x_return_stat_t xc_connect_by_workgroup_coords
  *	    temporary data structure. 
  *	  Create a connection index list for each task, sized to 
  *	    contain the master-list index of every endpoint needed by that task. 
+ *	  Allocate the endpoint area of each host task with connections, in
+ *	    the XLIB section of shared DRAM after the application data. 
+ *	  Allocate a ring in host shared memory for each connection between
+ *	    two host tasks (see x_host_ring.c). 
  */
 
 #define MYDESC "Setup global connection lists"
@@ -724,8 +749,10 @@ static
 x_return_stat_t xc_setup_application_connections ()
 {
     x_return_stat_t      result = X_ERROR;
-    int                  num_task_slots, task_slot;
+    int                  num_task_slots, task_slot, num_endpoints, index;
     x_task_descriptor_t *global_task_descriptors;
+    x_connection_t      *connection;
+    x_memory_offset_t    next_host_endpoints = (sizeof(x_application_t) + 7) & ~7;
         
     num_task_slots = x_application->host_task_slots +
         (x_application->workgroup_rows * x_application->workgroup_columns);        
@@ -741,6 +768,20 @@ x_return_stat_t xc_setup_application_connections ()
         printf ("%s: failed to allocate shared memory\n",MYDESC);
     }
     else {
+        for (index = 0; index < xc_master_elements_used; index++) {
+            connection = xc_master_connection_list + index;
+            if (x_is_host_task (connection->source_task) &&
+                x_is_host_task (connection->sink_task) &&
+                (connection->multicast == 0)) {
+                connection->host_ring = xhr_alloc_ring (
+                    (connection->buffer_size != 0) ? connection->buffer_size :
+                                                     XHR_DEFAULT_RING_BYTES);
+                if (connection->host_ring == 0) {
+                    printf ("%s: failed to allocate host shared memory\n",MYDESC);
+                    return X_ERROR;
+                }
+            }
+        }
         memcpy ((char*)x_application + x_application->connection_list_offset,
                 xc_master_connection_list, xc_master_elements_used*sizeof(x_connection_t));
         x_application->connection_list_length = xc_master_elements_used;
@@ -765,6 +806,20 @@ x_return_stat_t xc_setup_application_connections ()
                     global_task_descriptors[task_slot].num_connections =
                         xc_task_connection_index[task_slot]->elements_used;
                 }        
+                if (x_is_host_task (task_slot)) {
+                    num_endpoints = xc_task_connection_index[task_slot]->elements_used;
+                    if (next_host_endpoints + X_HOST_ENDPOINT_AREA_SIZE(num_endpoints) >
+                        X_LIB_SECTION_SIZE) {
+                        printf ("%s: no room in shared memory for the endpoints of host task %d\n",
+                                MYDESC, task_slot);
+                        return X_ERROR;
+                    }
+                    global_task_descriptors[task_slot].host_endpoints = 
+                        next_host_endpoints;
+                    memset ((char*)x_application + next_host_endpoints, 0, 
+                            X_HOST_STAGING_OFFSET(num_endpoints));
+                    next_host_endpoints += X_HOST_ENDPOINT_AREA_SIZE(num_endpoints);
+                }
             }                      
         }
         result = X_SUCCESS;          
@@ -772,6 +827,22 @@ x_return_stat_t xc_setup_application_connections ()
     return result;
 }
 
+/*  xc_publish_connections
+ *
+ *  Sets up the connections in shared memory the first time it is called,
+ *  and thereafter returns the result of doing so. 
+ */
+
+static 
+x_return_stat_t xc_publish_connections ()
+{
+    if (!xc_connections_published) {
+        xc_connections_published   = X_TRUE;
+        xc_connection_setup_result = xc_setup_application_connections ();
+    }
+    return xc_connection_setup_result;
+}
+
 /*---------------------- EXTERNALLY VISIBLE FUNCTIONS --------------------*/
 
 /*  x_get_application_state
@@ -887,6 +958,9 @@ x_application_state_t x_get_application_state (
  * Returns the actual workgroup size and number of host task slots. 
  * If the host process executable file name supplied is non-null, 
  * a task entry is created for the current host task.
+ * If there is no Epiphany device, the workgroup size is returned as 0x0
+ * and the application can be made up of host tasks only, with the
+ * application data in host shared memory (see x_host_ring.c). 
  */
 
 x_return_stat_t 
@@ -899,15 +973,27 @@ x_initialize_application (const char * caller_executable_file_name,
     x_return_stat_t result = X_ERROR;
     
     // Sanity checking
-    if ((x_epiphany_control != NULL) && (x_epiphany_control->initialized)) {
+    if (((x_epiphany_control != NULL) && (x_epiphany_control->initialized)) ||
+        (x_host_shared_memory != NULL)) {
         fprintf (stderr,"The application has already been initialized\n");
         return X_ERROR;
     }
+    // The host shared memory segment is needed for connections between
+    // host tasks, and is also where the application data are kept if
+    // there is no Epiphany device. 
+    if (NULL == (x_host_shared_memory = xhr_create_shared_memory ())) {
+        fprintf (stderr,"x_initialize_application: could not create host shared memory, aborting\n");
+        return X_ERROR;
+    }
+    x_application = NULL;
     // initialize system, read platform params from default HDF. 
     // Then, reset the platform and get the actual system parameters.
     // NB will clobber anything else running on the Epiphany!
     if (E_OK != e_init(NULL)) {
-        fprintf (stderr,"x_initialize_application: e_init failed, aborting\n");
+        fprintf (stderr,"x_initialize_application: e_init failed, running host tasks only\n");
+        *workgroup_rows    = 0;
+        *workgroup_columns = 0;
+        x_application = (x_application_t*)x_host_shared_memory;
     }
     else if (E_OK != e_reset_system()) {
         fprintf (stderr,"x_initialize_application: e_reset_system failed, aborting\n");
@@ -923,10 +1009,6 @@ x_initialize_application (const char * caller_executable_file_name,
     else {
         *workgroup_rows    = x_epiphany_control->workgroup.rows;
         *workgroup_columns = x_epiphany_control->workgroup.cols;
-        if (*host_task_slots == 0) {
-            *host_task_slots = x_get_host_core_count ();
-        }
-        // Initialise the application's shared memory data structures.
         x_application = (x_application_t*) 
             x_epiphany_to_host_address (x_epiphany_control, 0, 0, 
                                         X_EPIPHANY_SHARED_DRAM_BASE + 
@@ -936,33 +1018,44 @@ x_initialize_application (const char * caller_executable_file_name,
                      "%s: Internal error while getting address of application data error!\n",
                      "x_initialize_application");
         }
-        else {
-            x_application->workgroup_rows    = *workgroup_rows;
-            x_application->workgroup_columns = *workgroup_columns;
-            x_application->host_task_slots   = *host_task_slots;
-            x_application->connection_list_length       = 0;
-            x_application->task_descriptor_table_offset = 0;
-            x_application->connection_list_offset       = 0;
-            x_application->available_working_memory_start =
-                (void*)(x_application->working_memory) - 
-                (void*)(x_application);
-            x_application->available_working_memory_end =
-                x_application->available_working_memory_start +
-                sizeof(x_application->working_memory);
-            // Allocate dynamically sized areas from working memory
-            task_descriptor_table_length = 
-                (*workgroup_rows)*(*workgroup_columns) + (*host_task_slots);	
-            x_application->task_descriptor_table_offset =
-                xawm_allocz (task_descriptor_table_length * 
-                             sizeof(x_task_descriptor_t));
-            // If required, create a task descriptor for the host process
-            if (caller_executable_file_name != NULL) {
-                xtdt_init_task_descriptor (
-                            xtdt_next_available_host_task_descriptor(),  
-                            xawm_alloc_string(caller_executable_file_name));
-            }
-            result = X_SUCCESS;
+    }
+    if (x_application != NULL) {
+        if (*host_task_slots == 0) {
+            *host_task_slots = x_get_host_core_count ();
+        }
+        // Initialise the application's shared memory data structures.
+        x_application->workgroup_rows    = *workgroup_rows;
+        x_application->workgroup_columns = *workgroup_columns;
+        x_application->host_task_slots   = *host_task_slots;
+        x_application->mesh_options      = 0;
+        x_application->connection_list_length       = 0;
+        x_application->task_descriptor_table_offset = 0;
+        x_application->connection_list_offset       = 0;
+        xc_connections_published                    = X_FALSE;
+        x_application->available_working_memory_start =
+            (void*)(x_application->working_memory) - 
+            (void*)(x_application);
+        x_application->available_working_memory_end =
+            x_application->available_working_memory_start +
+            sizeof(x_application->working_memory);
+        // Allocate dynamically sized areas from working memory
+        task_descriptor_table_length = 
+            (*workgroup_rows)*(*workgroup_columns) + (*host_task_slots);	
+        x_application->task_descriptor_table_offset =
+            xawm_allocz (task_descriptor_table_length * 
+                         sizeof(x_task_descriptor_t));
+        // If required, create a task descriptor for the host process
+        if (caller_executable_file_name != NULL) {
+            xtdt_init_task_descriptor (
+                        xtdt_next_available_host_task_descriptor(),  
+                        xawm_alloc_string(caller_executable_file_name));
         }
+        result = X_SUCCESS;
+    }
+    else {
+        // Don't leave the segment behind, or a retry would find the
+        // application "already initialized"
+        xhr_remove_shared_memory ();
     }
     return result;
 }
@@ -971,12 +1064,16 @@ x_initialize_application (const char * caller_executable_file_name,
 
 /*  x_create_task
  *
+ *  A core ID of X_HOST_PROCESS creates a host task in the next free host
+ *  task slot, which is run as a separate process by x_launch_task. 
  */
 
 
 x_task_id_t 
 x_create_task (const char *executable_file_name, int core_id)
 {
+    x_task_descriptor_t *descriptor;
+
     if ( -1 == access (executable_file_name, R_OK) ) {
         printf ("Executable file %s cannot be accessed\n", executable_file_name);
         return X_ERROR;
@@ -985,6 +1082,18 @@ x_create_task (const char *executable_file_name, int core_id)
         printf ("Create Task: No application exists\n");
         return X_NO_APPLICATION_DATA;
     }
+    else if (core_id == X_HOST_PROCESS) {
+        if (NULL == (descriptor = xtdt_next_available_host_task_descriptor ())) {
+            printf ("Create Task: no host task slot is available\n");
+            return X_NULL_TASK;
+        }
+        if (0 != xtdt_init_task_descriptor (descriptor,
+                        xawm_alloc_string (executable_file_name))) {
+            printf ("Create Task: could not set up the task descriptor\n");
+            return X_NULL_TASK;
+        }
+        return x_task_descriptor_id (descriptor);
+    }
     else {
           
     }        
@@ -1044,6 +1153,7 @@ x_prepare_mesh_application (const char *workgroup_executable_file_name,
             }
         }
         // Create connections
+        x_application->mesh_options = mesh_options;
         for (row = 0; row < x_application->workgroup_rows; row++) {
             for (col = 0; col < x_application->workgroup_columns; col++) {
                 if ((col > 0) || (mesh_options & X_WRAPAROUND_MESH)) {
@@ -1101,11 +1211,87 @@ x_connect_tasks (x_task_id_t sender,   int sender_key,
         printf ("Connect Tasks: No application exists\n");
         result = X_ERROR;
     }
-    result = xc_connect_by_task_id (sender, sender_key, receiver, receiver_key);
+    result = xc_connect_by_task_id (sender, sender_key, receiver, receiver_key, 0, 0);
         
     return result;
 }
 
+/*  x_connect_tasks_buffered
+ *
+ *  As x_connect_tasks, but the sender does not wait for the receiver - 
+ *  messages are queued in a ring buffer of buffer_size bytes (rounded up
+ *  to a multiple of 8) in the receiver's local memory. 
+ *
+ *  The ring is allocated on the receiver's stack at task startup, so both
+ *  tasks must be workgroup tasks - or else both host tasks, whose 
+ *  connections always have a ring in host shared memory. Each 
+ *  message occupies its length plus 4 bytes, rounded up to a multiple of 8. 
+ */
+
+x_return_stat_t 
+x_connect_tasks_buffered (x_task_id_t sender,   int sender_key,
+                          x_task_id_t receiver, int receiver_key,
+                          size_t buffer_size)
+{
+    x_return_stat_t result = X_ERROR;
+        
+    if (x_application == NULL) {
+        printf ("Connect Tasks: No application exists\n");
+    }
+    else if (buffer_size < XB_RING_ALIGNMENT) {
+        printf ("Connect Tasks: buffer size %u is too small\n", 
+                (unsigned)buffer_size);
+    }
+    else if (x_is_host_task (sender) != x_is_host_task (receiver)) {
+        printf ("Connect Tasks: buffered connections cannot join a host task to a workgroup task\n");
+    }
+    else {
+        result = xc_connect_by_task_id (sender, sender_key, receiver, receiver_key,
+                                        XB_RING_BYTES(buffer_size), 0);
+    }
+    return result;
+}
+
+/*  x_connect_tasks_multicast
+ *
+ *  Connects one sending key to several receivers - see the notes on
+ *  multicast in x_connection_internals.h. The first connection is made
+ *  with the usual validation of the sender's key, the others skip it 
+ *  because they share that key. 
+ */
+
+x_return_stat_t 
+x_connect_tasks_multicast (x_task_id_t sender, int sender_key,
+                           int num_receivers,
+                           const x_task_id_t receivers[], 
+                           const int receiver_keys[])
+{
+    x_return_stat_t result = X_ERROR;
+    int             i;
+        
+    if (x_application == NULL) {
+        printf ("Connect Tasks: No application exists\n");
+    }
+    else if (num_receivers < 1) {
+        printf ("Connect Tasks: a multicast needs at least one receiver\n");
+    }
+    else if (num_receivers > X_MULTICAST_MAX_RECEIVERS) {
+        printf ("Connect Tasks: a multicast can have at most %d receivers\n",
+                X_MULTICAST_MAX_RECEIVERS);
+    }
+    else {
+        result = xc_connect_by_task_id (sender, sender_key, 
+                                        receivers[0], receiver_keys[0],
+                                        0, num_receivers);
+        for (i = 1; (i < num_receivers) && (result == X_SUCCESS); i++) {
+            result = xc_connect_by_task_id (sender, sender_key,
+                                            receivers[i], receiver_keys[i],
+                                            0, -1);
+        }
+    }
+    return result;
+}
+
 /*----------------------------- Task execution -----------------------------*/
 
 /*  x_launch_task
@@ -1113,14 +1299,28 @@ x_connect_tasks (x_task_id_t sender,   int sender_key,
  *  Loads and starts the specified task. If already running, the task is
  *  not affected and and warning is issued. 
  *  The optional parameters will be supplied to the task as its arguments. 
+ *
+ *  A host task is run in a new process, the optional parameters being a
+ *  NULL-terminated list of argument strings. The task ID is passed in the 
+ *  environment (see x_task.c). 
+ *
+ *  Since the connections must be in place for the task to find its 
+ *  endpoints, they are set up in shared memory here if this has not yet
+ *  been done - after which no more connections can be made. 
  */
 
+#define XLT_MAX_ARGUMENTS (32)
+
 x_return_stat_t x_launch_task (x_task_id_t task_id, ...)
 {
     x_return_stat_t      result = X_ERROR;
     x_task_descriptor_t *descriptor;
     pid_t                new_pid;
-    int                  e_result, row, column;
+    int                  e_result, row, column, argc;
+    char                *executable_file_name;
+    char                *argv[XLT_MAX_ARGUMENTS + 2];
+    char                 task_id_string[16];
+    va_list              args;
 
     if (x_application == NULL) {
         printf ("Launch Task: No application exists\n");
@@ -1140,6 +1340,9 @@ x_return_stat_t x_launch_task (x_task_id_t task_id, ...)
             printf ("Launch Task: task %d is already running\n", task_id);
             result = X_WARNING;
         }
+        else if (X_SUCCESS != xc_publish_connections ()) {
+            printf ("Launch Task: the connections could not be set up\n");
+        }
         else {
             if (x_is_workgroup_task(task_id)) {  
                 x_get_task_coordinates (task_id, &row, &column);
@@ -1155,6 +1358,19 @@ x_return_stat_t x_launch_task (x_task_id_t task_id, ...)
                 }
             }
             else if (x_is_host_task(task_id)) {
+                executable_file_name = ((char*)x_application) + 
+                                       descriptor->executable_file_name;
+                argv[0] = executable_file_name;
+                va_start (args, task_id);
+                for (argc = 1; argc <= XLT_MAX_ARGUMENTS; argc++) {
+                    if (NULL == (argv[argc] = va_arg (args, char *))) {
+                        break;
+                    }
+                }
+                va_end (args);
+                argv[argc] = NULL;
+                snprintf (task_id_string, sizeof(task_id_string), "%d", task_id);
+
                 // start task on host OS
                 new_pid = fork();
                 if (new_pid == -1) {
@@ -1163,13 +1379,20 @@ x_return_stat_t x_launch_task (x_task_id_t task_id, ...)
                 else if (new_pid != 0) {
                     // parent process: store PID in task descriptor
                     descriptor->coreid_or_pid = new_pid;
+                    result = X_SUCCESS;
                 }
                 else {
                     // new process: load the Unix executable
+                    setenv (X_TASK_ID_ENVIRONMENT_VARIABLE, task_id_string, 1);
+                    execv (executable_file_name, argv);
+                    fprintf (stderr, "Launch Task: exec %s for task %d failed\n",
+                             executable_file_name, task_id);
+                    _exit (X_ERROR);
                 }
             }                    
         }
     }        
+    return result;
 }
 
 /*  This launches any tasks that have not yet been started, passing the same string arguments
@@ -1202,10 +1425,11 @@ x_launch_application (int argc, char * argv[])
         printf ("Launch Application: No application exists\n");
         result = X_ERROR;
     }
+    else if (X_SUCCESS != xc_publish_connections ()) {
+        printf ("Launch Application: the connections could not be set up\n");
+        result = X_ERROR;
+    }
     else {
-
-        xc_setup_application_connections ();
-
         workgroup_size = x_application->workgroup_rows * 
                          x_application->workgroup_columns;     
                 
@@ -1333,19 +1557,25 @@ x_application_state_t x_finalize_application ()
     }
     else {
         result = x_get_application_state(NULL);
-        for (row = 0; row < x_application->workgroup_rows; row++) {
-            for (col = 0; col < x_application->workgroup_columns; col++) {
-                e_result = e_halt(&(x_epiphany_control->workgroup), row, col);
+        if (x_epiphany_control != NULL) {
+            for (row = 0; row < x_application->workgroup_rows; row++) {
+                for (col = 0; col < x_application->workgroup_columns; col++) {
+                    e_result = e_halt(&(x_epiphany_control->workgroup), row, col);
+                }
+            }
+            if (X_ERROR == x_unmap_epiphany_resources (x_epiphany_control)) {
+                fprintf (stderr, "%s: failed to unmap the Epiphany device and external RAM\n",
+                                 "x_finalize_application");
             }
+            if (E_OK != e_finalize()) {
+                fprintf (stderr, "%s: e_finalize() failed\n",
+                                 "x_finalize_application");
+            }  
         }
-        if (X_ERROR == x_unmap_epiphany_resources (x_epiphany_control)) {
-            fprintf (stderr, "%s: failed to unmap the Epiphany device and external RAM\n",
-                             "x_finalize_application");
+        if (x_application == (x_application_t*)x_host_shared_memory) {
+            x_application = NULL;
         }
-        if (E_OK != e_finalize()) {
-            fprintf (stderr, "%s: e_finalize() failed\n",
-                             "x_finalize_application");
-        }  
+        xhr_remove_shared_memory ();
         // And pull out the shiny Unix gun and kill any spawned tasks
           
         // And discard temporary data structures. 
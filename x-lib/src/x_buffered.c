@@ -0,0 +1,286 @@
+/*
+File: x_buffered.c
+
+Copyright 2013 Mark Honman
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/* Buffered connections
+
+  A buffered connection decouples the sender from the receiver: messages
+  are written into a ring buffer in the receiver's local memory, and the
+  sender only waits if the ring is full. The receiver takes messages out
+  of the ring at its own pace. 
+
+  Ring layout:
+    The ring is made up of records, each consisting of a 32-bit length 
+    followed by the message data, padded to a multiple of 8 bytes. The 
+    record header is always contiguous, but the message data may wrap 
+    around from the end of the ring to the start. 
+
+  Use of the endpoint words:
+    Sending endpoint
+      sequence           - head, the position at which the next record
+                           will be written. 
+      sequence_from_peer - tail, posted by the receiver as it consumes
+                           records. 
+      address_from_peer  - global address of the ring, and
+      control_from_peer  - size of the ring in bytes, both posted by the 
+                           receiver at startup. Zero until then. 
+    Receiving endpoint
+      sequence           - tail, the position of the next record to be read.
+      sequence_from_peer - head, posted by the sender after each record.
+      address_from_peer  - local address of the ring, and
+      control_from_peer  - size of the ring in bytes, these are never 
+                           written by the sender.
+
+  Head and tail positions run from 0 to twice the ring size, so that a
+  full ring (head - tail == ring size) can be told apart from an empty 
+  one (head == tail) without sacrificing a record's worth of space. 
+
+  Notes:
+    * The sender writes the data before posting the new head, and the 
+      receiver reads the data before posting the new tail. Writes from one
+      core to another are delivered in order, so neither side can see a
+      position update before the data it refers to. 
+    * x_sync is not meaningful on a buffered connection, because the 
+      sequence words are in use as ring positions. 
+    * Both sides wait for the peer with xc_wait_for_change, so that they
+      spin and then sleep as in the synchronous transfers - a host task 
+      backs off as in xc_host_backoff rather than holding a CPU. Every 
+      update of the ring or of a position rings the doorbell, which also
+      wakes a sleeping peer. 
+*/
+
+#include <unistd.h>
+#include "x_lib_configuration.h"
+#include "x_types.h"
+#include "x_error.h"
+#include "x_connection_internals.h"
+#include "x_transfer_internals.h"
+#include "x_buffered_internals.h"
+
+typedef uint32_t xb_record_header_t;
+
+/* xb_advance
+
+  Moves a ring position on by the given number of bytes, wrapping around
+  at twice the ring size. 
+*/
+
+static inline x_transfer_sequence_t xb_advance (x_transfer_sequence_t position,
+                                                uint32_t bytes,
+                                                uint32_t ring_bytes)
+{
+    position += bytes;
+    return (position >= 2*ring_bytes) ? position - 2*ring_bytes : position;
+}
+
+/* xb_offset
+
+  Converts a ring position into a byte offset in the ring. 
+*/
+
+static inline uint32_t xb_offset (x_transfer_sequence_t position,
+                                  uint32_t ring_bytes)
+{
+    return (position >= ring_bytes) ? position - ring_bytes : position;
+}
+
+/* xb_used
+
+  Number of bytes in the ring that have been written and not yet read. 
+*/
+
+static inline uint32_t xb_used (x_transfer_sequence_t head, 
+                                x_transfer_sequence_t tail,
+                                uint32_t ring_bytes)
+{
+    return (head >= tail) ? head - tail : head + 2*ring_bytes - tail;
+}
+
+static inline uint32_t xb_record_bytes (x_transfer_size_t size)
+{
+    return XB_RING_BYTES(sizeof(xb_record_header_t) + size);
+}
+
+/* xb_initialise_receiver
+   xb_post_ring
+
+  At startup the receiver records the location of its ring in its own
+  endpoint, and once the sender's endpoint is known posts the ring's
+  global address and size to the sender. The size is posted last - the 
+  sender waits for it to become non-zero before using the ring. 
+*/
+
+void xb_initialise_receiver (x_endpoint_t * local_endpoint, void * ring, 
+                             uint32_t ring_bytes)
+{
+    local_endpoint->mode              = X_BUFFERED_RECEIVING_ENDPOINT;
+    local_endpoint->address_from_peer = (x_transfer_address_t)ring;
+    local_endpoint->control_from_peer = ring_bytes;
+}
+
+void xb_post_ring (x_endpoint_t * local_endpoint)
+{
+    x_endpoint_t *remote_endpoint = local_endpoint->remote_endpoint;
+
+    remote_endpoint->address_from_peer = 
+        xtr_global_address ((void*)local_endpoint->address_from_peer);
+    remote_endpoint->control_from_peer = local_endpoint->control_from_peer;
+    xc_ring_doorbell (local_endpoint);
+}
+
+/* xb_send
+
+  Writes a message into the receiver's ring, waiting only if there is
+  not enough free space in the ring for it. 
+
+  Returns the size of the message, or -1 if the message is too big to 
+  ever fit in the ring. 
+*/
+
+int xb_send (x_endpoint_t * local_endpoint, const void * buf, 
+             x_transfer_size_t size)
+{
+    x_endpoint_t          *remote_endpoint = local_endpoint->remote_endpoint;
+    x_transfer_sequence_t  head = local_endpoint->sequence;
+    x_transfer_sequence_t  tail;
+    uint32_t               ring_bytes;
+    uint32_t               record_bytes = xb_record_bytes (size);
+    uint32_t               offset, first_part;
+    char                  *ring;
+
+    if (size == X_ENDPOINT_SYNC_CONTROL) {
+        return x_error (X_E_INVALID_TRANSFER_SIZE, size, local_endpoint);
+    }
+    xc_wait_for_change (local_endpoint, &local_endpoint->control_from_peer, 0);
+    ring_bytes = local_endpoint->control_from_peer;
+    if (record_bytes > ring_bytes) {
+        return x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, ring_bytes, 
+                        local_endpoint);
+    }
+    while (ring_bytes - xb_used (head, (tail = local_endpoint->sequence_from_peer),
+                                 ring_bytes) < record_bytes) {
+        xc_wait_for_change (local_endpoint, &local_endpoint->sequence_from_peer, tail);
+    }
+
+    ring   = (char*)local_endpoint->address_from_peer;
+    offset = xb_offset (head, ring_bytes);
+    *((volatile xb_record_header_t*)(ring + offset)) = size;
+    offset    += sizeof(xb_record_header_t);
+    first_part = ring_bytes - offset;
+    if (first_part >= size) {
+        xtr_transfer (ring + offset, buf, size);
+    }
+    else {
+        xtr_transfer (ring + offset, buf, first_part);
+        xtr_transfer (ring, (const char*)buf + first_part, size - first_part);
+    }
+
+    head = xb_advance (head, record_bytes, ring_bytes);
+    local_endpoint->sequence            = head;
+    remote_endpoint->sequence_from_peer = head;
+    xc_ring_doorbell (local_endpoint);
+    return size;
+}
+
+/* xb_receive
+
+  Takes the next message out of the ring, waiting for one to arrive if 
+  the ring is empty. 
+
+  Returns the size of the message, or -1 if the message is bigger than
+  the supplied buffer - in which case the message is left in the ring so
+  that it can be received into a bigger buffer. 
+*/
+
+int xb_receive (x_endpoint_t * local_endpoint, void * buf, 
+                x_transfer_size_t size)
+{
+    x_endpoint_t          *remote_endpoint = local_endpoint->remote_endpoint;
+    x_transfer_sequence_t  tail = local_endpoint->sequence;
+    uint32_t               ring_bytes = local_endpoint->control_from_peer;
+    char                  *ring = (char*)local_endpoint->address_from_peer;
+    uint32_t               offset, first_part;
+    xb_record_header_t     message_size;
+
+    xc_wait_for_change (local_endpoint, &local_endpoint->sequence_from_peer, tail);
+
+    offset       = xb_offset (tail, ring_bytes);
+    message_size = *((volatile xb_record_header_t*)(ring + offset));
+    if (message_size > size) {
+        return x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, message_size, 
+                        local_endpoint);
+    }
+    offset    += sizeof(xb_record_header_t);
+    first_part = ring_bytes - offset;
+    if (first_part >= message_size) {
+        xtr_copy (buf, ring + offset, message_size);
+    }
+    else {
+        xtr_copy (buf, ring + offset, first_part);
+        xtr_copy ((char*)buf + first_part, ring, message_size - first_part);
+    }
+
+    tail = xb_advance (tail, xb_record_bytes (message_size), ring_bytes);
+    local_endpoint->sequence            = tail;
+    remote_endpoint->sequence_from_peer = tail;
+    xc_ring_doorbell (local_endpoint);
+    return message_size;
+}
+
+/* xb_ready
+
+  A buffered sender is ready when the ring has been posted and is not 
+  full, a buffered receiver is ready when there is at least one message
+  in the ring. 
+*/
+
+x_bool_t xb_ready (x_endpoint_t * local_endpoint)
+{
+    uint32_t ring_bytes = local_endpoint->control_from_peer;
+
+    if (local_endpoint->mode == X_BUFFERED_SENDING_ENDPOINT) {
+        return (ring_bytes != 0) &&
+               (xb_used (local_endpoint->sequence, 
+                         local_endpoint->sequence_from_peer,
+                         ring_bytes) < ring_bytes);
+    }
+    else {
+        return (local_endpoint->sequence_from_peer != local_endpoint->sequence);
+    }
+}
+
+/* xb_room_for
+
+  Returns TRUE if a message of the given size can be written into the 
+  ring without waiting. A message that can never fit is reported as 
+  fitting, so that the caller goes on to get the error from xb_send. 
+*/
+
+x_bool_t xb_room_for (x_endpoint_t * local_endpoint, x_transfer_size_t size)
+{
+    uint32_t ring_bytes   = local_endpoint->control_from_peer;
+    uint32_t record_bytes = xb_record_bytes (size);
+
+    return (ring_bytes != 0) &&
+           ((record_bytes > ring_bytes) ||
+            (ring_bytes - xb_used (local_endpoint->sequence, 
+                                   local_endpoint->sequence_from_peer,
+                                   ring_bytes) >= record_bytes));
+}
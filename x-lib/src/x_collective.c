@@ -0,0 +1,746 @@
+/*
+File: x_collective.c
+
+Copyright 2013 Mark Honman
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "x_lib_configuration.h"
+#include "x_types.h"
+#include "x_error.h"
+#include "x_task.h"
+#include "x_endpoint.h"
+#include "x_exchange.h"
+#include "x_application.h"
+#include "x_collective.h"
+#include "x_application_internals.h"
+#include "x_connection_internals.h"
+
+/* Directions of the mesh neighbours, and the connection keys used by
+   x_prepare_mesh_application to reach them. 
+*/
+
+#define XCL_NONE       (-1)
+#define XCL_LEFT       (0)
+#define XCL_ABOVE      (1)
+#define XCL_RIGHT      (2)
+#define XCL_BELOW      (3)
+#define XCL_DIRECTIONS (4)
+
+static const int xcl_to_key[XCL_DIRECTIONS] = 
+    { X_TO_LEFT, X_TO_ABOVE, X_TO_RIGHT, X_TO_BELOW };
+
+static const int xcl_from_key[XCL_DIRECTIONS] = 
+    { X_FROM_LEFT, X_FROM_ABOVE, X_FROM_RIGHT, X_FROM_BELOW };
+
+/* The spanning tree used by the collectives: from the root along its 
+   row, then up and down each column. The parent is the neighbour that
+   is nearer to the root, the children those that are further away. 
+   Only the non-wraparound mesh connections are used, so that the tree 
+   works for either kind of mesh. 
+*/
+
+typedef struct {
+    int parent;
+    int num_children;
+    int child[XCL_DIRECTIONS];
+} xcl_tree_t;
+
+/* xcl_mesh_position
+
+  Finds the calling task's place in the mesh relative to the root.
+  Returns X_ERROR if the caller is not a workgroup task, or the root is
+  not in the workgroup. 
+*/
+
+static x_return_stat_t xcl_mesh_position (x_task_id_t root,
+                                          int *rows, int *cols, 
+                                          int *row, int *col,
+                                          int *root_row, int *root_col)
+{
+    x_get_task_environment (rows, cols, row, col);
+    if ((*row < 0) || (*col < 0)) {
+        return x_error (X_E_NOT_A_MESH_TASK, x_get_task_id(), NULL);
+    }
+    if ((root < 0) || (root >= (*rows) * (*cols))) {
+        return x_error (X_E_INVALID_COLLECTIVE_ROOT, root, NULL);
+    }
+    *root_row = root / *cols;
+    *root_col = root % *cols;
+    return X_SUCCESS;
+}
+
+/* xcl_spanning_tree
+
+  Works out the parent and children of the calling task in the tree 
+  rooted at root. 
+*/
+
+static x_return_stat_t xcl_spanning_tree (x_task_id_t root, xcl_tree_t *tree)
+{
+    int rows, cols, row, col, root_row, root_col;
+
+    if (xcl_mesh_position (root, &rows, &cols, &row, &col, 
+                           &root_row, &root_col) == X_ERROR) {
+        return X_ERROR;
+    }
+    tree->num_children = 0;
+    if (row == root_row) {
+        // Along the row, then into the columns
+        tree->parent = (col > root_col) ? XCL_LEFT  :
+                       (col < root_col) ? XCL_RIGHT : XCL_NONE;
+        if ((col >= root_col) && (col+1 < cols)) {
+            tree->child[tree->num_children++] = XCL_RIGHT;
+        }
+        if ((col <= root_col) && (col > 0)) {
+            tree->child[tree->num_children++] = XCL_LEFT;
+        }
+        if (row+1 < rows) {
+            tree->child[tree->num_children++] = XCL_BELOW;
+        }
+        if (row > 0) {
+            tree->child[tree->num_children++] = XCL_ABOVE;
+        }
+    }
+    else if (row > root_row) {
+        tree->parent = XCL_ABOVE;
+        if (row+1 < rows) {
+            tree->child[tree->num_children++] = XCL_BELOW;
+        }
+    }
+    else {
+        tree->parent = XCL_BELOW;
+        if (row > 0) {
+            tree->child[tree->num_children++] = XCL_ABOVE;
+        }
+    }
+    return X_SUCCESS;
+}
+
+/* xcl_segment_size
+
+  Size of segment number n of a buffer, 0 if there is no such segment. 
+*/
+
+static size_t xcl_segment_size (size_t size, size_t n)
+{
+    size_t offset = n * X_COLLECTIVE_SEGMENT_SIZE;
+
+    if (offset >= size) {
+        return 0;
+    }
+    else if (size - offset < X_COLLECTIVE_SEGMENT_SIZE) {
+        return size - offset;
+    }
+    else {
+        return X_COLLECTIVE_SEGMENT_SIZE;
+    }
+}
+
+/* x_broadcast
+
+  Each step is a single exchange in which the next segment is received
+  from the parent while the previous one is sent to all of the children. 
+  The root has nothing to receive, so its sends are simply one step 
+  behind those of its children, and a leaf has nothing to send. 
+*/
+
+x_return_stat_t x_broadcast (x_task_id_t root, void *buf, size_t size)
+{
+    xcl_tree_t          tree;
+    x_endpoint_handle_t parent = NULL,
+                        child[XCL_DIRECTIONS];
+    uint64_t            list_storage[(X_EXCHANGE_LIST_SIZE(XCL_DIRECTIONS+1)+7)/8];
+    x_exchange_list_t   list = (x_exchange_list_t)list_storage;
+    size_t              num_segments, n, receive_size, send_size;
+    int                 i;
+
+    if (xcl_spanning_tree (root, &tree) == X_ERROR) {
+        return X_ERROR;
+    }
+    if (tree.parent != XCL_NONE) {
+        parent = x_get_endpoint (xcl_from_key[tree.parent]);
+        if (parent == NULL) {
+            return X_ERROR;
+        }
+    }
+    for (i = 0; i < tree.num_children; i++) {
+        child[i] = x_get_endpoint (xcl_to_key[tree.child[i]]);
+        if (child[i] == NULL) {
+            return X_ERROR;
+        }
+    }
+
+    num_segments = (size + X_COLLECTIVE_SEGMENT_SIZE - 1) / X_COLLECTIVE_SEGMENT_SIZE;
+    for (n = 0; n <= num_segments; n++) {
+        x_init_exchange_list (list, XCL_DIRECTIONS+1);
+        receive_size = (parent != NULL) ? xcl_segment_size (size, n) : 0;
+        if (receive_size > 0) {
+            x_add_exchange_element (list, parent, 
+                                    (char*)buf + n*X_COLLECTIVE_SEGMENT_SIZE,
+                                    receive_size);
+        }
+        send_size = (n > 0) ? xcl_segment_size (size, n-1) : 0;
+        if (send_size > 0) {
+            for (i = 0; i < tree.num_children; i++) {
+                x_add_exchange_element (list, child[i], 
+                                        (char*)buf + (n-1)*X_COLLECTIVE_SEGMENT_SIZE,
+                                        send_size);
+            }
+        }
+        if ((list->num_entries > 0) && (x_sync_exchange (list) == X_ERROR)) {
+            return X_ERROR;
+        }
+    }
+    return X_SUCCESS;
+}
+
+/* xcl_check_reduction
+
+  Validates the arguments common to the reductions. 
+*/
+
+static x_return_stat_t xcl_check_reduction (int count, int type, int op)
+{
+    if ((count < 0) || 
+        ((type != X_REDUCE_INT32) && (type != X_REDUCE_FLOAT))) {
+        return x_error (X_E_INVALID_REDUCTION, type, NULL);
+    }
+    if ((op != X_REDUCE_SUM) && (op != X_REDUCE_MIN) && (op != X_REDUCE_MAX)) {
+        return x_error (X_E_INVALID_REDUCTION, op, NULL);
+    }
+    return X_SUCCESS;
+}
+
+/* xcl_combine
+
+  Combines count elements of the operand into the accumulator. 
+  Both element types are 4 bytes, see XCL_ELEMENT_SIZE. 
+*/
+
+#define XCL_ELEMENT_SIZE (4)
+
+static void xcl_combine (void *accumulator, const void *operand, int count,
+                         int type, int op)
+{
+    int i;
+
+    if (type == X_REDUCE_INT32) {
+        int32_t       *a = (int32_t*)accumulator;
+        const int32_t *b = (const int32_t*)operand;
+        switch (op) {
+        case X_REDUCE_SUM:
+            for (i = 0; i < count; i++) a[i] += b[i];
+            break;
+        case X_REDUCE_MIN:
+            for (i = 0; i < count; i++) if (b[i] < a[i]) a[i] = b[i];
+            break;
+        case X_REDUCE_MAX:
+            for (i = 0; i < count; i++) if (b[i] > a[i]) a[i] = b[i];
+            break;
+        }
+    }
+    else {
+        float       *a = (float*)accumulator;
+        const float *b = (const float*)operand;
+        switch (op) {
+        case X_REDUCE_SUM:
+            for (i = 0; i < count; i++) a[i] += b[i];
+            break;
+        case X_REDUCE_MIN:
+            for (i = 0; i < count; i++) if (b[i] < a[i]) a[i] = b[i];
+            break;
+        case X_REDUCE_MAX:
+            for (i = 0; i < count; i++) if (b[i] > a[i]) a[i] = b[i];
+            break;
+        }
+    }
+}
+
+/* x_reduce
+
+  Segment by segment, the contributions of the children are received 
+  and combined in a fixed order (so that the result does not depend on
+  timing), and the partial result passed on to the parent. 
+*/
+
+x_return_stat_t x_reduce (x_task_id_t root, void *buf, int count, 
+                          int type, int op)
+{
+    xcl_tree_t          tree;
+    x_endpoint_handle_t parent = NULL,
+                        child[XCL_DIRECTIONS];
+    uint32_t            operand[X_COLLECTIVE_SEGMENT_SIZE/sizeof(uint32_t)];
+    size_t              size = (size_t)count * XCL_ELEMENT_SIZE,
+                        num_segments, n, segment_size;
+    char               *segment;
+    int                 i;
+
+    if ((xcl_check_reduction (count, type, op) == X_ERROR) ||
+        (xcl_spanning_tree (root, &tree) == X_ERROR)) {
+        return X_ERROR;
+    }
+    if (tree.parent != XCL_NONE) {
+        parent = x_get_endpoint (xcl_to_key[tree.parent]);
+        if (parent == NULL) {
+            return X_ERROR;
+        }
+    }
+    for (i = 0; i < tree.num_children; i++) {
+        child[i] = x_get_endpoint (xcl_from_key[tree.child[i]]);
+        if (child[i] == NULL) {
+            return X_ERROR;
+        }
+    }
+
+    num_segments = (size + X_COLLECTIVE_SEGMENT_SIZE - 1) / X_COLLECTIVE_SEGMENT_SIZE;
+    for (n = 0; n < num_segments; n++) {
+        segment      = (char*)buf + n*X_COLLECTIVE_SEGMENT_SIZE;
+        segment_size = xcl_segment_size (size, n);
+        for (i = 0; i < tree.num_children; i++) {
+            if (x_sync_receive (child[i], operand, segment_size) != segment_size) {
+                return X_ERROR;
+            }
+            xcl_combine (segment, operand, segment_size / XCL_ELEMENT_SIZE,
+                         type, op);
+        }
+        if ((parent != NULL) && 
+            (x_sync_send (parent, segment, segment_size) != segment_size)) {
+            return X_ERROR;
+        }
+    }
+    return X_SUCCESS;
+}
+
+/* xcl_ring_allreduce
+
+  Allreduce of a block of up to one segment around a ring of tasks, given
+  the keys to the next task and from the previous one, and the caller's
+  position in the ring. 
+
+  The block is split into one chunk per task. In the reduce-scatter phase,
+  at step s the task sends chunk (position - s) onwards, and receives and
+  combines chunk (position - s - 1). After ring_size - 1 steps the task 
+  holds the final value of chunk (position + 1), which is passed around 
+  the ring in the allgather phase, each received chunk being sent on at
+  the next step. Chunks may be empty when the block is short. 
+*/
+
+static void xcl_chunk (int count, int ring_size, int chunk, 
+                       int *first, int *chunk_count)
+{
+    chunk = ((chunk % ring_size) + ring_size) % ring_size;
+    *first       = (count * chunk) / ring_size;
+    *chunk_count = (count * (chunk+1)) / ring_size - *first;
+}
+
+static x_return_stat_t xcl_ring_allreduce (int to_key, int from_key,
+                                           int ring_size, int position,
+                                           void *block, int count,
+                                           int type, int op, void *operand)
+{
+    x_endpoint_handle_t next, previous;
+    uint64_t            list_storage[(X_EXCHANGE_LIST_SIZE(2)+7)/8];
+    x_exchange_list_t   list = (x_exchange_list_t)list_storage;
+    int32_t            *element = (int32_t*)block;
+    int                 send_first, send_count, receive_first, receive_count;
+    int                 s;
+
+    if (ring_size < 2) {
+        return X_SUCCESS;
+    }
+    next     = x_get_endpoint (to_key);
+    previous = x_get_endpoint (from_key);
+    if ((next == NULL) || (previous == NULL)) {
+        return X_ERROR;
+    }
+
+    // Reduce-scatter
+    for (s = 0; s < ring_size - 1; s++) {
+        xcl_chunk (count, ring_size, position - s, &send_first, &send_count);
+        xcl_chunk (count, ring_size, position - s - 1, 
+                   &receive_first, &receive_count);
+        x_init_exchange_list (list, 2);
+        if (send_count > 0) {
+            x_add_exchange_element (list, next, element + send_first,
+                                    send_count * XCL_ELEMENT_SIZE);
+        }
+        if (receive_count > 0) {
+            x_add_exchange_element (list, previous, operand,
+                                    receive_count * XCL_ELEMENT_SIZE);
+        }
+        if ((list->num_entries > 0) && (x_sync_exchange (list) == X_ERROR)) {
+            return X_ERROR;
+        }
+        xcl_combine (element + receive_first, operand, receive_count, type, op);
+    }
+
+    // Allgather
+    for (s = 0; s < ring_size - 1; s++) {
+        xcl_chunk (count, ring_size, position + 1 - s, &send_first, &send_count);
+        xcl_chunk (count, ring_size, position - s, 
+                   &receive_first, &receive_count);
+        x_init_exchange_list (list, 2);
+        if (send_count > 0) {
+            x_add_exchange_element (list, next, element + send_first,
+                                    send_count * XCL_ELEMENT_SIZE);
+        }
+        if (receive_count > 0) {
+            x_add_exchange_element (list, previous, element + receive_first,
+                                    receive_count * XCL_ELEMENT_SIZE);
+        }
+        if ((list->num_entries > 0) && (x_sync_exchange (list) == X_ERROR)) {
+            return X_ERROR;
+        }
+    }
+    return X_SUCCESS;
+}
+
+/* x_allreduce
+
+  The wraparound mesh is reduced a segment at a time, around each row 
+  ring and then each column ring. Because every task of a row ends the
+  row phase with identical values, the column phase gives identical 
+  results in every column. 
+*/
+
+x_return_stat_t x_allreduce (void *buf, int count, int type, int op)
+{
+    uint32_t operand[X_COLLECTIVE_SEGMENT_SIZE/sizeof(uint32_t)];
+    int      rows, cols, row, col, root_row, root_col;
+    int      segment_count = X_COLLECTIVE_SEGMENT_SIZE / XCL_ELEMENT_SIZE;
+    int      first, block_count;
+
+    if ((xcl_check_reduction (count, type, op) == X_ERROR) ||
+        (xcl_mesh_position (0, &rows, &cols, &row, &col, 
+                            &root_row, &root_col) == X_ERROR)) {
+        return X_ERROR;
+    }
+    if ((x_application->mesh_options & X_WRAPAROUND_MESH) == 0) {
+        if (x_reduce (0, buf, count, type, op) == X_ERROR) {
+            return X_ERROR;
+        }
+        return x_broadcast (0, buf, (size_t)count * XCL_ELEMENT_SIZE);
+    }
+    for (first = 0; first < count; first += segment_count) {
+        block_count = (count - first < segment_count) ? count - first 
+                                                      : segment_count;
+        if ((xcl_ring_allreduce (X_TO_RIGHT, X_FROM_LEFT, cols, col,
+                                 (int32_t*)buf + first, block_count,
+                                 type, op, operand) == X_ERROR) ||
+            (xcl_ring_allreduce (X_TO_BELOW, X_FROM_ABOVE, rows, row,
+                                 (int32_t*)buf + first, block_count,
+                                 type, op, operand) == X_ERROR)) {
+            return X_ERROR;
+        }
+    }
+    return X_SUCCESS;
+}
+
+/* x_barrier
+
+  In round k each task writes the barrier number into flag word k of the
+  task 2^k places after it, then waits for the task 2^k places before it 
+  to do the same. The barrier number is written rather than incremented, 
+  and compared allowing for wraparound, so that a peer that has already 
+  raced on into the next barrier cannot cause a signal to be missed. 
+
+  A peer publishes the address of its flags when it starts, so the first
+  barrier may have to wait for that. The addresses are then kept in 
+  xcl_barrier_peer_flags, and the number of tasks in 
+  xcl_barrier_num_tasks, so that later barriers do not read the 
+  application data in DRAM. The peers are fixed by the task's position,
+  which does not change. 
+*/
+
+static volatile uint32_t *xcl_barrier_peer_flags[X_BARRIER_MAX_ROUNDS];
+static int                xcl_barrier_num_tasks = 0;
+
+x_return_stat_t x_barrier (void)
+{
+    static uint32_t      barrier_number = 0;
+    x_task_descriptor_t *descriptor_table, *peer_descriptor;
+    x_task_state_t       previous_state;
+    x_task_id_t          my_task_id;
+    int                  rows, cols, row, col, num_tasks, distance, round;
+
+    if (xcl_barrier_num_tasks == 0) {
+        x_get_task_environment (&rows, &cols, &row, &col);
+        if ((row < 0) || (col < 0)) {
+            return x_error (X_E_NOT_A_MESH_TASK, x_get_task_id(), NULL);
+        }
+        num_tasks  = rows * cols;
+        if (num_tasks > (1 << X_BARRIER_MAX_ROUNDS)) {
+            return x_error (X_E_TOO_MANY_BARRIER_ROUNDS, num_tasks, NULL);
+        }
+        xcl_barrier_num_tasks = num_tasks;
+    }
+    num_tasks  = xcl_barrier_num_tasks;
+    my_task_id = x_get_task_id();
+
+    barrier_number++;
+    previous_state = xt_set_task_state (X_BARRIER_WAITING_TASK);
+    for (round = 0, distance = 1; distance < num_tasks; round++, distance <<= 1) {
+        if (xcl_barrier_peer_flags[round] == NULL) {
+            descriptor_table = (x_task_descriptor_t*)
+                (((char*)x_application) + 
+                 x_application->task_descriptor_table_offset);
+            peer_descriptor = descriptor_table + 
+                              ((my_task_id + distance) % num_tasks);
+            while (peer_descriptor->barrier_flags == 0) {
+                // peer has not started yet
+            }
+            xcl_barrier_peer_flags[round] = 
+                (volatile uint32_t*)peer_descriptor->barrier_flags;
+        }
+        xcl_barrier_peer_flags[round][round] = barrier_number;
+        while ((int32_t)(x_barrier_flags[round] - barrier_number) < 0) {
+            // wait for the signal from the task distance places before
+        }
+    }
+    xt_set_task_state (previous_state);
+    return X_SUCCESS;
+}
+
+/* xcl_gather_bundle
+
+  Copies the blocks of one bundle, which may be scattered through the 
+  source with the given strides, into contiguous memory. 
+*/
+
+static void xcl_gather_bundle (char *dest, const char *source, int bundle,
+                               int num_blocks, size_t bundle_stride, 
+                               size_t block_stride, size_t block_size)
+{
+    int i;
+
+    for (i = 0; i < num_blocks; i++) {
+        memcpy (dest + i*block_size, 
+                source + bundle*bundle_stride + i*block_stride, block_size);
+    }
+}
+
+/* xcl_ring_alltoall
+
+  All-to-all around a ring of ring_size tasks. Bundle j of the source 
+  (num_blocks blocks, gathered using the strides) goes to the task at 
+  position j, and on return bundle i of the result holds the bundle from
+  the task at position i. The transit area must hold 2 * (ring_size - 1)
+  bundles.
+
+  At the first step each task sends all of its bundles for other tasks
+  onwards, in order of distance. At each later step the task keeps the
+  first of the bundles it has just received, which is its own, and sends
+  the rest onwards, so the message shrinks by one bundle per step. The
+  two halves of the transit area are used alternately for receiving. 
+*/
+
+static x_return_stat_t xcl_ring_alltoall (int to_key, int from_key,
+                                          int ring_size, int position,
+                                          const char *source, char *result,
+                                          int num_blocks, size_t bundle_stride,
+                                          size_t block_stride, size_t block_size,
+                                          char *transit)
+{
+    x_endpoint_handle_t next, previous;
+    uint64_t            list_storage[(X_EXCHANGE_LIST_SIZE(2)+7)/8];
+    x_exchange_list_t   list = (x_exchange_list_t)list_storage;
+    size_t              bundle_size = num_blocks * block_size;
+    char               *half[2], *sending;
+    int                 s, distance, receiving_half = 1;
+
+    xcl_gather_bundle (result + position*bundle_size, source, position,
+                       num_blocks, bundle_stride, block_stride, block_size);
+    if (ring_size < 2) {
+        return X_SUCCESS;
+    }
+    next     = x_get_endpoint (to_key);
+    previous = x_get_endpoint (from_key);
+    if ((next == NULL) || (previous == NULL)) {
+        return X_ERROR;
+    }
+    half[0] = transit;
+    half[1] = transit + (ring_size - 1)*bundle_size;
+    for (distance = 1; distance < ring_size; distance++) {
+        xcl_gather_bundle (half[0] + (distance-1)*bundle_size, source,
+                           (position + distance) % ring_size,
+                           num_blocks, bundle_stride, block_stride, block_size);
+    }
+    sending = half[0];
+    for (s = 1; s < ring_size; s++) {
+        x_init_exchange_list (list, 2);
+        x_add_exchange_element (list, next, sending, 
+                                (ring_size - s) * bundle_size);
+        x_add_exchange_element (list, previous, half[receiving_half],
+                                (ring_size - s) * bundle_size);
+        if (x_sync_exchange (list) == X_ERROR) {
+            return X_ERROR;
+        }
+        memcpy (result + ((position - s + ring_size) % ring_size)*bundle_size,
+                half[receiving_half], bundle_size);
+        sending = half[receiving_half] + bundle_size;
+        receiving_half = 1 - receiving_half;
+    }
+    return X_SUCCESS;
+}
+
+/* x_alltoall
+
+  In the row phase, task (r,c) sends to each column c' of its row the 
+  blocks for all of the tasks in column c'. Afterwards the workspace 
+  holds, for each column q of the row, the blocks from task (r,q) for 
+  the tasks of column c, in row order. In the column phase each task 
+  sends to each row r' of its column the blocks for task (r',c), which 
+  arrive as the contiguous run of blocks from row r of the receive 
+  buffer. 
+*/
+
+x_return_stat_t x_alltoall (const void *send_buf, void *receive_buf,
+                            size_t block_size, void *workspace)
+{
+    int    rows, cols, row, col, root_row, root_col;
+    size_t num_tasks;
+    char  *intermediate = (char*)workspace,
+          *transit;
+
+    if (xcl_mesh_position (0, &rows, &cols, &row, &col, 
+                           &root_row, &root_col) == X_ERROR) {
+        return X_ERROR;
+    }
+    if ((x_application->mesh_options & X_WRAPAROUND_MESH) == 0) {
+        return x_error (X_E_NEEDS_WRAPAROUND_MESH, 0, NULL);
+    }
+    if (((cols - 1) * rows * block_size > X_ENDPOINT_SIZE_MASK) ||
+        ((rows - 1) * cols * block_size > X_ENDPOINT_SIZE_MASK)) {
+        return x_error (X_E_INVALID_TRANSFER_SIZE, block_size, NULL);
+    }
+    num_tasks = rows * cols;
+    transit   = intermediate + num_tasks * block_size;
+
+    if (xcl_ring_alltoall (X_TO_RIGHT, X_FROM_LEFT, cols, col,
+                           (const char*)send_buf, intermediate,
+                           rows, block_size, cols * block_size, block_size,
+                           transit) == X_ERROR) {
+        return X_ERROR;
+    }
+    return xcl_ring_alltoall (X_TO_BELOW, X_FROM_ABOVE, rows, row,
+                              intermediate, (char*)receive_buf,
+                              cols, block_size, rows * block_size, block_size,
+                              transit);
+}
+
+/* xcl_edge_layout
+
+  Sets up a layout of count rows of row_bytes bytes, pitch bytes apart. 
+*/
+
+static void xcl_edge_layout (x_stride_t *layout, char *base, size_t row_bytes,
+                             int count, int32_t pitch)
+{
+    layout->base         = base;
+    layout->element_size = row_bytes;
+    layout->inner_count  = 1;
+    layout->inner_stride = row_bytes;
+    layout->outer_count  = count;
+    layout->outer_stride = pitch;
+}
+
+/* x_halo_exchange
+
+  A neighbour exists on a side unless the task is on that edge of a mesh
+  without wraparound connections - both neighbours come to the same
+  conclusion, so they agree on which transfers take place. 
+  The layouts are on the stack, which is fine because the strided 
+  receivers' layouts are only read by the peers during the exchange. 
+*/
+
+x_return_stat_t x_halo_exchange (void *local_tile, int width, int height,
+                                 int halo_depth, size_t element_size)
+{
+    uint64_t          list_storage[(X_EXCHANGE_LIST_SIZE(2*XCL_DIRECTIONS)+7)/8];
+    x_exchange_list_t list = (x_exchange_list_t)list_storage;
+    x_stride_t        edge[XCL_DIRECTIONS], halo[XCL_DIRECTIONS];
+    x_bool_t          wraparound;
+    char             *interior;
+    int32_t           pitch;
+    size_t            row_bytes, column_bytes;
+    int               rows, cols, row, col, root_row, root_col, d;
+    x_bool_t          present[XCL_DIRECTIONS];
+    x_endpoint_handle_t to[XCL_DIRECTIONS], from[XCL_DIRECTIONS];
+
+    if (xcl_mesh_position (0, &rows, &cols, &row, &col, 
+                           &root_row, &root_col) == X_ERROR) {
+        return X_ERROR;
+    }
+    row_bytes    = (size_t)width * element_size;
+    column_bytes = (size_t)halo_depth * element_size;
+    if ((halo_depth <= 0) || (halo_depth > width) || (halo_depth > height) ||
+        (row_bytes > 0xFFFF) || (height > 0xFFFF)) {
+        return x_error (X_E_INVALID_TRANSFER_SIZE, halo_depth, local_tile);
+    }
+    pitch    = (width + 2*halo_depth) * element_size;
+    interior = (char*)local_tile + halo_depth*pitch + column_bytes;
+
+    // Rows above and below: halo_depth rows of the interior width
+    xcl_edge_layout (&edge[XCL_ABOVE], interior, row_bytes, halo_depth, pitch);
+    xcl_edge_layout (&halo[XCL_ABOVE], interior - halo_depth*pitch, 
+                     row_bytes, halo_depth, pitch);
+    xcl_edge_layout (&edge[XCL_BELOW], interior + (height - halo_depth)*pitch,
+                     row_bytes, halo_depth, pitch);
+    xcl_edge_layout (&halo[XCL_BELOW], interior + height*pitch,
+                     row_bytes, halo_depth, pitch);
+    // Columns to the left and right: halo_depth elements of each row
+    xcl_edge_layout (&edge[XCL_LEFT], interior, column_bytes, height, pitch);
+    xcl_edge_layout (&halo[XCL_LEFT], interior - column_bytes, 
+                     column_bytes, height, pitch);
+    xcl_edge_layout (&edge[XCL_RIGHT], interior + row_bytes - column_bytes,
+                     column_bytes, height, pitch);
+    xcl_edge_layout (&halo[XCL_RIGHT], interior + row_bytes,
+                     column_bytes, height, pitch);
+
+    wraparound = (x_application->mesh_options & X_WRAPAROUND_MESH) != 0;
+    present[XCL_LEFT]  = wraparound || (col > 0);
+    present[XCL_RIGHT] = wraparound || (col+1 < cols);
+    present[XCL_ABOVE] = wraparound || (row > 0);
+    present[XCL_BELOW] = wraparound || (row+1 < rows);
+
+    for (d = 0; d < XCL_DIRECTIONS; d++) {
+        if (present[d]) {
+            to[d]   = x_get_endpoint (xcl_to_key[d]);
+            from[d] = x_get_endpoint (xcl_from_key[d]);
+            if ((to[d] == NULL) || (from[d] == NULL)) {
+                return X_ERROR;
+            }
+        }
+    }
+
+    x_init_exchange_list (list, 2*XCL_DIRECTIONS);
+    for (d = 0; d < XCL_DIRECTIONS; d++) {
+        if (present[d] &&
+            ((x_add_exchange_strided_element (list, to[d], &edge[d]) == X_ERROR) ||
+             (x_add_exchange_strided_element (list, from[d], &halo[d]) == X_ERROR))) {
+            return X_ERROR;
+        }
+    }
+    if (list->num_entries == 0) {
+        return X_SUCCESS;
+    }
+    return x_sync_exchange (list);
+}
@@ -20,14 +20,27 @@ see the files COPYING and COPYING.LESSER. If not, see
 */
 
 #include <unistd.h>
+#ifdef __epiphany__
+#include <e_lib.h>
+#else
+#include <sched.h>
+#include <time.h>
+#endif
+#include "x_lib_configuration.h"
 #include "x_error.h"
 #include "x_endpoint.h"
 #include "x_application_internals.h"
 #include "x_connection_internals.h"
+#include "x_buffered_internals.h"
+#include "x_host_ring_internals.h"
 
 /* x_endpoint_ready
 
   Returns TRUE if the peer has indicated its readiness to communicate.
+  For buffered and host ring connections, TRUE if a send would not have
+  to wait for space in the ring, or a receive would not have to wait for
+  a message.
+  For a multicast connection, TRUE once all of the receivers are ready.
 
   Rollover case needs to be tested!
 */
@@ -35,6 +48,385 @@ see the files COPYING and COPYING.LESSER. If not, see
 x_bool_t x_endpoint_ready (x_endpoint_handle_t endpoint)
 {
   x_endpoint_t *local_endpoint = (x_endpoint_t*)endpoint;
+  int           i, num_receivers;
+
+  if ((local_endpoint->mode == X_BUFFERED_SENDING_ENDPOINT) ||
+      (local_endpoint->mode == X_BUFFERED_RECEIVING_ENDPOINT)) {
+    return xb_ready (local_endpoint);
+  }
+#ifndef __epiphany__
+  if ((local_endpoint->mode == X_HOST_RING_SENDING_ENDPOINT) ||
+      (local_endpoint->mode == X_HOST_RING_RECEIVING_ENDPOINT)) {
+    return xhr_ready (local_endpoint);
+  }
+#endif
+  if (local_endpoint->mode == X_MULTICAST_SENDING_ENDPOINT) {
+    num_receivers = local_endpoint->num_receivers;
+    for (i = 0; i < num_receivers; i++) {
+      if (local_endpoint[i].sequence_from_peer != (local_endpoint[i].sequence + 1)) {
+        return X_FALSE;
+      }
+    }
+    return X_TRUE;
+  }
   return (local_endpoint->sequence_from_peer == (local_endpoint->sequence + 1));
 }
 
+
+#ifdef __epiphany__
+
+/* XC_STATUS_GID
+
+  The global interrupt disable bit of the STATUS register. A task that 
+  sleeps must enable interrupts to be woken, and afterwards puts them 
+  back as it found them, so that a caller that has disabled interrupts
+  does not have them turned on behind its back. 
+*/
+
+#define XC_STATUS_GID ((uint32_t)(1 << 1))
+
+static inline uint32_t xc_interrupt_state ()
+{
+    uint32_t status;
+
+    __asm__ __volatile__ ("movfs %0, status" : "=r" (status));
+    return status & XC_STATUS_GID;
+}
+
+static inline void xc_restore_interrupt_state (uint32_t state)
+{
+    if (!state) {
+        __asm__ __volatile__ ("gie");
+    }
+}
+
+/* xc_set_idle_in_peers
+
+  Puts the given value in idle_from_peer of the peer endpoints of each 
+  of the endpoints (every receiver of a multicast sender), reading it 
+  back from each. Returns FALSE (having done nothing) if any of the 
+  peers is a host task, since it cannot raise the interrupt. 
+*/
+
+static x_bool_t xc_set_idle_in_peers (x_endpoint_handle_t endpoints[], 
+                                      int num_endpoints,
+                                      x_transfer_address_t idle)
+{
+  x_endpoint_t *local_endpoint;
+  int           i, j, num_peers;
+
+  for (i = 0; i < num_endpoints; i++) {
+    local_endpoint = (x_endpoint_t*)endpoints[i];
+    num_peers      = local_endpoint->num_receivers;
+    for (j = 0; j < num_peers; j++) {
+      if ((((x_transfer_address_t)local_endpoint[j].remote_endpoint) >> 25) ==
+          (X_EPIPHANY_SHARED_DRAM_BASE >> 25)) {
+        return X_FALSE;
+      }
+    }
+  }
+  for (i = 0; i < num_endpoints; i++) {
+    local_endpoint = (x_endpoint_t*)endpoints[i];
+    num_peers      = local_endpoint->num_receivers;
+    for (j = 0; j < num_peers; j++) {
+      local_endpoint[j].remote_endpoint->idle_from_peer = idle;
+      (void)local_endpoint[j].remote_endpoint->idle_from_peer;
+    }
+  }
+  return X_TRUE;
+}
+
+/* xc_wait_for_doorbell
+
+  The wait of x_wait_any, which spins and then sleeps in the same way as
+  xc_wait_for_peer. The task's ILATST address is put in the peer endpoint
+  of every endpoint waited on, since the peer wakes the task after 
+  ringing the doorbell. 
+*/
+
+static void xc_wait_for_doorbell (x_endpoint_handle_t endpoints[], 
+                                  int num_endpoints)
+{
+  uint32_t interrupt_state;
+  unsigned spins;
+
+  if (xc_wait_spin_budget != 0) {
+    for (spins = xc_wait_spin_budget; spins != 0; spins--) {
+      if (*x_task_doorbell != 0) {
+        return;
+      }
+    }
+    interrupt_state = xc_interrupt_state ();
+    for (;;) {
+      __asm__ __volatile__ ("gid");
+      if (!xc_set_idle_in_peers (endpoints, num_endpoints, 
+                   x_global_address_local_coreid_bits | XC_ILATST_ADDRESS)) {
+        xc_restore_interrupt_state (interrupt_state);
+        break;
+      }
+      if (*x_task_doorbell != 0) {
+        xc_set_idle_in_peers (endpoints, num_endpoints, 0);
+        xc_restore_interrupt_state (interrupt_state);
+        return;
+      }
+      __asm__ __volatile__ ("gie\n\tidle");
+    }
+  }
+  while (*x_task_doorbell == 0) { } ;
+}
+
+#endif
+
+/* x_wait_any
+
+  Waits for any of the endpoints to become ready, returning the index of
+  a ready endpoint. 
+
+  Fairness is round-robin: the scan starts with the endpoint following 
+  the one that was selected by the previous call. The last selection is
+  remembered per task rather than per endpoint array, so a task that 
+  alternates between different endpoint arrays gets approximately 
+  round-robin behaviour. 
+
+  Algorithm:
+    Repeat
+      Clear the task's doorbell
+      Scan the endpoints for one that is ready, returning it if found
+      Wait for a peer to ring the doorbell
+
+  Notes:
+    * The wait spins and then sleeps as xc_wait_for_peer does, see 
+      xc_wait_for_doorbell. 
+    * The doorbell is cleared before the scan, so a peer that becomes 
+      ready during the scan rings it again afterwards and the wait falls
+      straight through. 
+    * Peers ring the doorbell for all of the task's endpoints, so the 
+      wait can end without any of these endpoints being ready - in which
+      case the scan simply finds nothing and the wait is resumed. 
+*/
+
+int x_wait_any (x_endpoint_handle_t endpoints[], int num_endpoints)
+{
+  static int last_selected = -1;
+  int        index, i;
+#ifndef __epiphany__
+  unsigned   polls;
+#endif
+
+  if (num_endpoints <= 0) {
+    return x_error (X_E_EMPTY_ENDPOINT_LIST, num_endpoints, endpoints);
+  }
+  for (;;) {
+    *x_task_doorbell = 0;
+    index = last_selected;
+    for (i = 0; i < num_endpoints; i++) {
+      index = (index + 1 >= num_endpoints) ? 0 : index + 1;
+      if (x_endpoint_ready (endpoints[index])) {
+        last_selected = index;
+        return index;
+      }
+    }
+#ifdef __epiphany__
+    xc_wait_for_doorbell (endpoints, num_endpoints);
+#else
+    for (polls = 0; *x_task_doorbell == 0; ) {
+      xc_host_backoff (&polls);
+    }
+#endif
+  }
+}
+
+/* xc_wait_spin_budget
+
+   Number of polls before a waiting task sleeps, zero for never. 
+*/
+
+#ifdef __epiphany__
+unsigned xc_wait_spin_budget = X_MESSAGING_WAIT_SPIN_BUDGET;
+#else
+unsigned xc_wait_spin_budget = X_HOST_WAIT_SPIN_BUDGET;
+#endif
+
+#ifdef __epiphany__
+
+/* xc_wake_handler
+
+  The user interrupt handler. Its only job is to end the IDLE state, but
+  if the interrupt arrives after xc_wait_for_peer has decided to sleep
+  and before IDLE is executed, the return address is that of the IDLE 
+  instruction. The handler then steps over it, since otherwise the core
+  would sleep with nobody left to wake it. 
+*/
+
+#define XC_IDLE_OPCODE ((uint16_t)0x01B2)
+
+static void __attribute__((interrupt)) xc_wake_handler (int signum)
+{
+    uint32_t return_address;
+
+    __asm__ __volatile__ ("movfs %0, iret" : "=r" (return_address));
+    if (*((uint16_t*)return_address) == XC_IDLE_OPCODE) {
+        __asm__ __volatile__ ("movts iret, %0" : : "r" (return_address + 2));
+    }
+}
+
+#endif
+
+/* x_set_wait_spin_budget
+
+   The interrupt handler is attached the first time a non-zero budget is 
+   set, and stays attached. Only the user interrupt is unmasked - global
+   interrupts are enabled just while a task sleeps, see XC_STATUS_GID. 
+*/
+
+void x_set_wait_spin_budget (unsigned spin_budget)
+{
+#ifdef __epiphany__
+    static x_bool_t handler_attached = X_FALSE;
+
+    if ((spin_budget != 0) && !handler_attached) {
+        e_irq_attach (E_USER_INT, xc_wake_handler);
+        e_irq_mask (E_USER_INT, E_FALSE);
+        handler_attached = X_TRUE;
+    }
+#endif
+    xc_wait_spin_budget = spin_budget;
+}
+
+#ifndef __epiphany__
+
+/* xc_host_backoff
+
+  Called by a host task each time that it polls and finds nothing, with 
+  a count (initially zero) of the polls so far. Returns at once for the 
+  first xc_wait_spin_budget polls, then yields the CPU for the next 
+  X_HOST_WAIT_YIELDS, and then sleeps for a time that doubles at each 
+  poll up to X_HOST_WAIT_MAX_SLEEP_USECS. A zero budget means poll for 
+  ever. 
+*/
+
+void xc_host_backoff (unsigned * polls)
+{
+    struct timespec pause;
+    unsigned        sleeps, usecs;
+
+    if ((xc_wait_spin_budget == 0) || (*polls < xc_wait_spin_budget)) {
+        (*polls)++;
+        return;
+    }
+    if (*polls - xc_wait_spin_budget < X_HOST_WAIT_YIELDS) {
+        (*polls)++;
+        sched_yield ();
+        return;
+    }
+    sleeps = *polls - xc_wait_spin_budget - X_HOST_WAIT_YIELDS;
+    usecs  = (sleeps < 16) ? (1u << sleeps) : X_HOST_WAIT_MAX_SLEEP_USECS;
+    if (usecs >= X_HOST_WAIT_MAX_SLEEP_USECS) {
+        usecs = X_HOST_WAIT_MAX_SLEEP_USECS;
+    }
+    else {
+        (*polls)++;
+    }
+    pause.tv_sec  = 0;
+    pause.tv_nsec = usecs * 1000;
+    nanosleep (&pause, NULL);
+}
+
+#endif
+
+/* xc_wait_for_peer
+   xc_wait_for_progress
+
+  Waits for a peer to post the given sequence number to a word of the
+  local endpoint, which the caller has already found not to be there. 
+  xc_wait_for_progress also returns as soon as a second word (a count of
+  bytes transferred) changes from the value last seen, so that a large
+  receiver can pick up each chunk as it arrives. Without a sequence word
+  (NULL) it only waits for the change, see xc_wait_for_change. 
+
+  Algorithm (Epiphany):
+    If the budget is non-zero and the peer is another core
+      Poll the word up to xc_wait_spin_budget times
+      Until the sequence number has arrived
+        Disable interrupts
+        Put the address of this core's ILATST in the peer's endpoint,
+          and read it back
+        If the sequence number has still not arrived
+          Enable interrupts and IDLE
+      Clear the word in the peer's endpoint and restore the interrupt
+        state
+    Otherwise poll for ever
+
+  Notes:
+    * The read-back ensures that the peer can see that this core is idle
+      before the final test of the word. Read responses travel back on 
+      the same network and route as the peer's writes, so if the peer 
+      posted before it could see this, the posted sequence number has 
+      arrived by the time the read-back completes. Otherwise the peer 
+      raises the interrupt. 
+    * The interrupt is latched while interrupts are disabled, and taken
+      immediately after they are enabled, see xc_wake_handler. 
+    * A stale interrupt merely causes another trip round the loop. 
+    * Host peers cannot raise the interrupt, so waits for a host task 
+      (whose endpoints are in shared DRAM) always poll. 
+    * On the host the wait backs off as in xc_host_backoff. The peer is 
+      a core, which cannot wake a futex, so the last stage is a timed 
+      sleep. 
+    * A sender that posts progress wakes the waiter after each post, as
+      it does after posting a sequence number. 
+*/
+
+#define XC_PEER_HAS_POSTED(word, sequence, progress, seen) \
+    ((((word) != NULL) && ((int32_t)(*(word) - (sequence)) >= 0)) || \
+     (((progress) != NULL) && (*(progress) != (seen))))
+
+void xc_wait_for_peer (x_endpoint_t * local_endpoint, 
+                       volatile x_transfer_sequence_t * word,
+                       x_transfer_sequence_t sequence)
+{
+    xc_wait_for_progress (local_endpoint, word, sequence, NULL, 0);
+}
+
+void xc_wait_for_progress (x_endpoint_t * local_endpoint, 
+                           volatile x_transfer_sequence_t * word,
+                           x_transfer_sequence_t sequence,
+                           volatile x_transfer_control_t * progress,
+                           x_transfer_control_t seen)
+{
+#ifdef __epiphany__
+    x_endpoint_t *remote_endpoint = local_endpoint->remote_endpoint;
+    uint32_t      interrupt_state;
+    unsigned      spins;
+
+    if ((xc_wait_spin_budget != 0) && 
+        ((((x_transfer_address_t)remote_endpoint) >> 25) != 
+         (X_EPIPHANY_SHARED_DRAM_BASE >> 25))) {
+        for (spins = xc_wait_spin_budget; spins != 0; spins--) {
+            if (XC_PEER_HAS_POSTED (word, sequence, progress, seen)) {
+                return;
+            }
+        }
+        interrupt_state = xc_interrupt_state ();
+        for (;;) {
+            __asm__ __volatile__ ("gid");
+            remote_endpoint->idle_from_peer = 
+                x_global_address_local_coreid_bits | XC_ILATST_ADDRESS;
+            (void)remote_endpoint->idle_from_peer;
+            if (XC_PEER_HAS_POSTED (word, sequence, progress, seen)) {
+                break;
+            }
+            __asm__ __volatile__ ("gie\n\tidle");
+        }
+        remote_endpoint->idle_from_peer = 0;
+        xc_restore_interrupt_state (interrupt_state);
+        return;
+    }
+    while (!XC_PEER_HAS_POSTED (word, sequence, progress, seen)) { } ;
+#else
+    unsigned polls = 0;
+
+    while (!XC_PEER_HAS_POSTED (word, sequence, progress, seen)) {
+        xc_host_backoff (&polls);
+    }
+#endif
+}
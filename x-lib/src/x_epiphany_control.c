@@ -304,4 +304,44 @@ x_epiphany_to_host_address (x_epiphany_control_t * epiphany_control,
     return result;
 }
 
+/*  x_host_to_epiphany_address
+ *
+ *  External memory is checked first since that is where host tasks have their
+ *  endpoints and buffers. Addresses in core memory are given the coreid of 
+ *  the core concerned. 
+ */
+
+uint32_t
+x_host_to_epiphany_address (x_epiphany_control_t * epiphany_control, 
+                            const void * host_address)
+{
+    const char *address = (const char*)host_address;
+    char       *base;
+    e_mem_t    *mem_seg_p;
+    int         mem_seg, row, col;
+
+    for (mem_seg = 0; 
+         mem_seg < epiphany_control->num_external_memory_mappings; 
+         mem_seg++) {
+        mem_seg_p = epiphany_control->external_memory_mappings + mem_seg;
+        base      = (char*)mem_seg_p->base;
+        if ((address >= base) && (address < base + mem_seg_p->map_size)) {
+            return mem_seg_p->ephy_base + (uint32_t)(address - base);
+        }
+    }
+    for (row = 0; row < epiphany_control->workgroup.rows; row++) {
+        for (col = 0; col < epiphany_control->workgroup.cols; col++) {
+            base = (char*)epiphany_control->workgroup.core[row][col].mems.base;
+            if ((address >= base) && 
+                (address < base + 
+                           epiphany_control->workgroup.core[row][col].mems.map_size)) {
+                return (((uint32_t)epiphany_control->workgroup.core[row][col].id)
+                        << X_EPIPHANY_ADDRESS_COREID_SHIFT) | 
+                       (uint32_t)(address - base);
+            }
+        }
+    }
+    return 0;
+}
+
 #endif
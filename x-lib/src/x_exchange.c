@@ -0,0 +1,505 @@
+/*
+File: x_exchange.c
+
+Copyright 2013 Mark Honman
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "x_lib_configuration.h"
+#include "x_types.h"
+#include "x_error.h"
+#include "x_endpoint.h"
+#include "x_exchange.h"
+#include "x_connection_internals.h"
+#include "x_transfer_internals.h"
+
+/* Exchange element states. 
+
+   An element is OFFERED once the address, size and sequence number have 
+   been posted to the peer, and DONE once the transfer has completed or an
+   error has been detected. A receiving element is COMPLETING while it 
+   waits for the sender to signal completion of the transfer. 
+
+   In a background exchange a sending element is ACCEPTED once the peer's
+   offer has been validated, and stays in that state until a DMA channel
+   is available. It is TRANSFERRING while the DMA engine moves the data. 
+*/
+
+#define XE_IDLE         (0)
+#define XE_OFFERED      (1)
+#define XE_COMPLETING   (2)
+#define XE_DONE         (3)
+#define XE_ACCEPTED     (4)
+#define XE_TRANSFERRING (5)
+
+/* x_new_exchange_list
+   x_init_exchange_list
+
+   An exchange list can either be allocated from the heap, or the caller
+   can supply storage of X_EXCHANGE_LIST_SIZE(max_entries) bytes - on
+   the Epiphany the stack is usually the best place for this.
+
+   x_new_exchange_list returns NULL if no memory is available. 
+*/
+
+x_exchange_list_t x_new_exchange_list (unsigned max_entries)
+{
+    x_exchange_list_t result;
+
+    result = (x_exchange_list_t) malloc (X_EXCHANGE_LIST_SIZE(max_entries));
+    if (result != NULL) {
+        x_init_exchange_list (result, max_entries);
+    }
+    return result;
+}
+
+void x_init_exchange_list (x_exchange_list_t exchange_list, unsigned max_entries)
+{
+    exchange_list->max_entries = max_entries;
+    exchange_list->num_entries = 0;
+}
+
+/* x_add_exchange_element
+
+   Appends a transfer to the exchange list. Whether data are sent or 
+   received depends on the type of endpoint. 
+
+   Error conditions:
+     The exchange list is full.
+     The endpoint is already in the list - the endpoint protocol only 
+       permits one outstanding transfer per endpoint. 
+*/
+
+x_return_stat_t x_add_exchange_element (x_exchange_list_t   exchange_list, 
+                                        x_endpoint_handle_t endpoint, 
+                                        void              * buffer, 
+                                        size_t              size)
+{
+    x_exchange_element_t *element;
+    unsigned              i;
+
+    if (exchange_list->num_entries >= exchange_list->max_entries) {
+        return x_error (X_E_EXCHANGE_LIST_FULL, exchange_list->max_entries, 
+                        exchange_list);
+    }
+    for (i = 0; i < exchange_list->num_entries; i++) {
+        if (exchange_list->element[i].endpoint == endpoint) {
+            return x_error (X_E_DUPLICATE_EXCHANGE_ENDPOINT, i, endpoint);
+        }
+    }
+    element = exchange_list->element + exchange_list->num_entries;
+    element->endpoint = endpoint;
+    element->buffer   = buffer;
+    element->size     = size;
+    element->layout   = NULL;
+    element->state    = XE_IDLE;
+    element->result   = -1;
+    exchange_list->num_entries++;
+    return X_SUCCESS;
+}
+
+/* x_add_exchange_strided_element
+
+   The element's buffer and size are the base and total size of the 
+   layout, so that the exchange logic only needs to look at the layout
+   when offering a receive buffer and when copying the data. 
+*/
+
+x_return_stat_t x_add_exchange_strided_element (x_exchange_list_t   exchange_list,
+                                                x_endpoint_handle_t endpoint,
+                                                const x_stride_t  * layout)
+{
+    size_t total = (size_t)layout->element_size * layout->inner_count *
+                   layout->outer_count;
+
+    if (x_add_exchange_element (exchange_list, endpoint, layout->base, total)
+        == X_ERROR) {
+        return X_ERROR;
+    }
+    exchange_list->element[exchange_list->num_entries - 1].layout = layout;
+    return X_SUCCESS;
+}
+
+/* xe_offer
+
+  Posts the buffer address, size, and next sequence number to the peer -
+  exactly as the first part of x_sync_send or x_sync_receive. 
+
+  A zero size is offered to the peer (which will then flag the mismatch
+  on its side) but sizes that cannot be represented in the transfer 
+  control word are rejected without involving the peer. 
+  A strided receiver offers its layout instead of a buffer, exactly as
+  x_sync_receive_strided does. 
+  Exchanges are for Epiphany tasks only: on the host every element fails
+  the mode check (see xc_core_endpoint_mode), so the exchange fails 
+  without posting anything. 
+*/
+
+static void xe_offer (x_exchange_element_t *element)
+{
+    x_endpoint_t *local_endpoint  = (x_endpoint_t*) element->endpoint;
+    x_endpoint_t *remote_endpoint = local_endpoint->remote_endpoint;
+
+    if (!xc_core_endpoint_mode (local_endpoint, X_SENDING_ENDPOINT) && 
+        !xc_core_endpoint_mode (local_endpoint, X_RECEIVING_ENDPOINT) &&
+        !xc_core_endpoint_mode (local_endpoint, X_MULTICAST_SENDING_ENDPOINT) &&
+        !xc_core_endpoint_mode (local_endpoint, X_MULTICAST_MEMBER_ENDPOINT)) {
+        x_error (X_E_ENDPOINT_MODE_MISMATCH, 0, local_endpoint);
+        element->state = XE_DONE;
+    }
+    else if (element->size > (x_transfer_size_t)(~0)) {
+        x_error (X_E_INVALID_TRANSFER_SIZE, element->size, local_endpoint);
+        element->state = XE_DONE;
+    }
+    else {
+        if ((element->layout != NULL) && 
+            (local_endpoint->mode == X_RECEIVING_ENDPOINT)) {
+            remote_endpoint->address_from_peer = xtr_global_address (element->layout);
+            remote_endpoint->control_from_peer = X_ENDPOINT_STRIDED_CONTROL | 
+                                                 element->size;
+        }
+        else {
+            remote_endpoint->address_from_peer = xtr_global_address (element->buffer);
+            remote_endpoint->control_from_peer = element->size;
+        }
+        remote_endpoint->sequence_from_peer = local_endpoint->sequence + 1;
+        xc_ring_doorbell (local_endpoint);
+        element->state = XE_OFFERED;
+    }
+}
+
+/* xe_complete_send
+
+  Tells the receiver that the transfer is finished, exactly as at the end
+  of x_sync_send. A transferred size of X_ENDPOINT_SYNC_CONTROL tells the
+  receiver that the transfer was abandoned. 
+*/
+
+static void xe_complete_send (x_exchange_element_t *element,
+                              x_transfer_control_t  transferred)
+{
+    x_endpoint_t *local_endpoint  = (x_endpoint_t*) element->endpoint;
+    x_endpoint_t *remote_endpoint = local_endpoint->remote_endpoint;
+
+    local_endpoint->sequence++;
+    remote_endpoint->transferred_from_peer = transferred;
+    remote_endpoint->completed_from_peer   = local_endpoint->sequence;
+    xc_wake_peer (local_endpoint);
+    element->state = XE_DONE;
+}
+
+/* xe_start_transfer
+
+  Moves the data for a sending element whose peer has accepted the offer.
+  In a synchronous exchange, or when either side has a segment list or
+  strided layout, the data is copied immediately. In a background 
+  exchange the transfer is handed to a free DMA channel if there is one,
+  otherwise the element is left ACCEPTED and another attempt is made at
+  the next poll. 
+*/
+
+static void xe_start_transfer (x_exchange_element_t *element, x_bool_t background)
+{
+    x_endpoint_t *local_endpoint  = (x_endpoint_t*) element->endpoint;
+#ifdef __epiphany__
+    int           channel;
+
+    if (background && (element->layout == NULL) &&
+        !(local_endpoint->control_from_peer & X_ENDPOINT_CONTROL_FLAGS)) {
+        channel = xtr_dma_acquire (element);
+        if (channel < 0) {
+            element->state = XE_ACCEPTED;
+            return;
+        }
+        if (X_SUCCESS == xtr_dma_start (channel, 
+                                        (void*)local_endpoint->address_from_peer,
+                                        element->buffer, element->size)) {
+            element->state = XE_TRANSFERRING;
+            return;
+        }
+        xtr_dma_release (channel);
+        // otherwise fall back to copying the data 
+    }
+#endif
+    if ((element->layout != NULL) ||
+        (local_endpoint->control_from_peer & X_ENDPOINT_CONTROL_FLAGS)) {
+        if (0 > xtr_special_transfer (element->buffer, element->size, 
+                                      NULL, 0, element->layout,
+                                      local_endpoint->address_from_peer,
+                                      local_endpoint->control_from_peer)) {
+            element->result = -1;
+            xe_complete_send (element, X_ENDPOINT_SYNC_CONTROL);
+            return;
+        }
+    }
+    else {
+        xtr_transfer ((void*)local_endpoint->address_from_peer, 
+                      element->buffer, element->size);
+    }
+    xe_complete_send (element, element->size);
+}
+
+/* xe_transfer_finished
+
+  Returns TRUE if the background transfer of an element has finished,
+  in which case its DMA channel is released. 
+*/
+
+static x_bool_t xe_transfer_finished (x_exchange_element_t *element)
+{
+#ifdef __epiphany__
+    int channel = xtr_dma_channel_of (element);
+
+    if (channel >= 0) {
+        if (xtr_dma_busy (channel)) {
+            return X_FALSE;
+        }
+        xtr_dma_release (channel);
+    }
+#endif
+    return X_TRUE;
+}
+
+/* xe_progress
+
+  Advances an offered element as far as possible without waiting. 
+  Returns TRUE if the element is DONE. 
+
+  The peer's offer is considered to have arrived once the sequence 
+  number from the peer has reached the offered sequence number. A 
+  sender that has already completed the transfer may have gone on to 
+  post its next offer, so this test is not an exact match - and in that
+  case the receiver goes by the completion sequence number rather than
+  the (overwritten) size offered by the sender. 
+
+  The validation of the peer's offer is otherwise the same as in 
+  x_sync_send and x_sync_receive, so that both peers make the same 
+  decision as to whether the transfer is done. 
+
+  The result of a sending element is set as soon as the peer's offer has
+  been accepted, that of a receiving element when the sender signals 
+  completion - or, for a sender that has set the pull flag, once the 
+  receiver has fetched the data itself. 
+*/
+
+static x_bool_t xe_progress (x_exchange_element_t *element, x_bool_t background)
+{
+    x_endpoint_t         *local_endpoint  = (x_endpoint_t*) element->endpoint;
+    x_transfer_sequence_t offer_sequence  = local_endpoint->sequence + 1;
+    x_bool_t              sending = (local_endpoint->mode != X_RECEIVING_ENDPOINT);
+    x_bool_t              peer_completed;
+    x_transfer_control_t  size_from_peer;
+
+    if (element->state == XE_OFFERED) {
+        if ((int32_t)(local_endpoint->sequence_from_peer - offer_sequence) >= 0) {
+            size_from_peer = local_endpoint->control_from_peer;
+            peer_completed = !sending && 
+                             (local_endpoint->completed_from_peer == offer_sequence);
+            if (element->size == X_ENDPOINT_SYNC_CONTROL) {
+                x_error (X_E_INVALID_TRANSFER_SIZE, element->size, local_endpoint);
+            }
+            else if (!peer_completed && (size_from_peer == X_ENDPOINT_SYNC_CONTROL)) {
+                x_error (X_E_SYNC_TRANSFER_MISMATCH, size_from_peer, local_endpoint);
+            }
+            else if (sending && (size_from_peer < element->size)) {
+                x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, size_from_peer, 
+                         local_endpoint);
+            }
+            else if (!sending && !peer_completed && 
+                     (size_from_peer > element->size)) {
+                if ((size_from_peer & X_ENDPOINT_PULL_CONTROL) && 
+                    (element->layout == NULL) &&
+                    ((size_from_peer & ~X_ENDPOINT_PULL_CONTROL) <= element->size)) {
+                    element->result = xtr_pull (local_endpoint, element->buffer,
+                                                size_from_peer & X_ENDPOINT_SIZE_MASK,
+                                                offer_sequence);
+                    local_endpoint->sequence = offer_sequence;
+                    element->state = XE_DONE;
+                }
+                else {
+                    x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, size_from_peer, 
+                             local_endpoint);
+                }
+            }
+            else if (sending) {
+                element->result = element->size;
+                xe_start_transfer (element, background);
+            }
+            else {
+                element->state = XE_COMPLETING;
+            }
+            if (element->state == XE_OFFERED) {
+                if (sending) {
+                    xe_complete_send (element, X_ENDPOINT_SYNC_CONTROL);
+                }
+                else {
+                    local_endpoint->sequence = offer_sequence;
+                    element->state = XE_DONE;
+                }
+            }
+        }
+    }
+    else if (element->state == XE_ACCEPTED) {
+        xe_start_transfer (element, background);
+    }
+    else if (element->state == XE_TRANSFERRING) {
+        if (xe_transfer_finished (element)) {
+            xe_complete_send (element, element->size);
+        }
+    }
+    if (element->state == XE_COMPLETING) {
+        if (local_endpoint->completed_from_peer == offer_sequence) {
+            size_from_peer = local_endpoint->transferred_from_peer;
+            if (size_from_peer == X_ENDPOINT_SYNC_CONTROL) {
+                x_error (X_E_SYNC_TRANSFER_MISMATCH, size_from_peer, local_endpoint);
+            }
+            else {
+                element->result = size_from_peer;
+            }
+            local_endpoint->sequence = offer_sequence;
+            element->state = XE_DONE;
+        }
+    }
+    return (element->state == XE_DONE);
+}
+
+/* xe_offer_all
+
+  Posts offers for every element in the list, returning the number of
+  elements that were successfully offered. 
+*/
+
+static unsigned xe_offer_all (x_exchange_list_t exchange_list)
+{
+    x_exchange_element_t *element, 
+                         *after_last_element = exchange_list->element + 
+                                               exchange_list->num_entries;
+    unsigned              offered = 0;
+
+    for (element = exchange_list->element; element < after_last_element; element++) {
+        element->result = -1;
+        xe_offer (element);
+        if (element->state != XE_DONE) {
+            offered++;
+        }
+    }
+    return offered;
+}
+
+/* x_sync_exchange
+
+  Performs all of the transfers in the exchange list, returning when all
+  of them have completed. 
+
+  Algorithm:
+    Post offers for all of the elements. 
+    Until all elements are done
+      Poll each unfinished element, advancing it as far as possible. 
+    
+  Notes:
+    * The data are moved by the sender, as in x_sync_send - so a receiving
+      element costs this core very little. 
+    * Sending elements are copied in the order in which their receivers
+      become ready. 
+*/
+
+int x_sync_exchange (x_exchange_list_t exchange_list)
+{
+    x_exchange_element_t *element, 
+                         *after_last_element = exchange_list->element + 
+                                               exchange_list->num_entries;
+    unsigned              outstanding;
+    int                   errors = 0;
+
+    outstanding = xe_offer_all (exchange_list);
+    while (outstanding > 0) {
+        for (element = exchange_list->element; element < after_last_element; element++) {
+            if ((element->state != XE_DONE) && xe_progress (element, X_FALSE)) {
+                outstanding--;
+            }
+        }
+    }
+    for (element = exchange_list->element; element < after_last_element; element++) {
+        if (element->result < 0) {
+            errors++;
+        }
+    }
+    return (errors == 0 ? X_SUCCESS : X_ERROR);
+}
+
+/* x_background_exchange
+
+  Starts all of the transfers in the exchange list and returns without 
+  waiting for any of them to complete. The caller must then poll 
+  x_exchange_done until it returns TRUE - the transfers only progress
+  while being polled, but a large transfer proceeds under DMA between
+  polls. 
+
+  Neither the exchange list nor the buffers may be altered until the
+  exchange is done. 
+
+  Returns X_ERROR if any of the elements could not be offered to its
+  peer, otherwise X_SUCCESS. Those elements are DONE with a result of 
+  -1, but the others have been offered, so x_exchange_done must still 
+  be polled to finish them. 
+
+  Notes:
+    * Sending elements are moved by the DMA engine, using whichever of
+      the core's DMA channels is free. 
+    * The caller must not use the DMA channels while an exchange is in
+      progress. 
+*/
+
+int x_background_exchange (x_exchange_list_t exchange_list)
+{
+    x_exchange_element_t *element, 
+                         *after_last_element = exchange_list->element + 
+                                               exchange_list->num_entries;
+    unsigned              offered;
+
+    offered = xe_offer_all (exchange_list);
+    for (element = exchange_list->element; element < after_last_element; element++) {
+        if (element->state != XE_DONE) {
+            xe_progress (element, X_TRUE);
+        }
+    }
+    return (offered == exchange_list->num_entries ? X_SUCCESS : X_ERROR);
+}
+
+/* x_exchange_done
+
+  Advances a background exchange as far as possible without waiting,
+  returning TRUE once every element of the exchange is done. 
+  The element results show which transfers succeeded. 
+*/
+
+x_bool_t x_exchange_done (x_exchange_list_t exchange_list)
+{
+    x_exchange_element_t *element, 
+                         *after_last_element = exchange_list->element + 
+                                               exchange_list->num_entries;
+    x_bool_t              result = X_TRUE;
+
+    for (element = exchange_list->element; element < after_last_element; element++) {
+        if ((element->state != XE_DONE) && !xe_progress (element, X_TRUE)) {
+            result = X_FALSE;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,398 @@
+/*
+File: x_host_ring.c
+
+Copyright 2013 Mark Honman
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/* Host-to-host connections
+
+  Two host tasks are processes on the same Linux system, so there is no
+  need to involve the Epiphany's shared DRAM (which is slow to access 
+  from the host, and cannot be used for futexes) when they communicate. 
+  Instead each connection between two host tasks has a ring buffer in a 
+  POSIX shared memory segment, through which messages are passed exactly
+  as in a buffered connection (see x_buffered.c): the sender only waits 
+  when the ring is full, and the receiver when it is empty. Waiting is 
+  done by polling briefly and then blocking on a futex, so a waiting host
+  task does not occupy a CPU. 
+
+  The segment is created by x_initialize_application, and opened by each 
+  host task at startup using the name passed in the environment. When 
+  there is no Epiphany device the first X_LIB_SECTION_SIZE bytes of the 
+  segment stand in for the XLIB section of shared DRAM, holding the 
+  application data, so that applications made up only of host tasks can
+  be run on any Linux system. The rings follow. 
+
+  Ring layout:
+    A header holding the head and tail positions and the flags used in 
+    blocking, followed by the ring itself. The ring is made up of records
+    of the same form as in x_buffered.c - a 32-bit length followed by the
+    message data, padded to a multiple of 8 bytes. Head and tail run from
+    0 to twice the ring size. 
+
+  Use of the endpoint words:
+    sequence           - the local copy of the head (in the sender) or 
+                         tail (in the receiver). 
+    address_from_peer  - the offset of the ring header in the segment, 
+                         which (unlike an address) is the same in every
+                         process. 
+    control_from_peer  - the ring size in bytes. 
+    These are set up at startup, so nothing is ever written by the peer. 
+
+  Notes:
+    * The sender writes the data before posting the new head, and the 
+      receiver reads the data before posting the new tail, with a memory
+      barrier between, since the ARM does not guarantee the ordering of 
+      stores to normal memory. 
+    * A waiter sets its waiting flag before checking the position once 
+      more and going to sleep, and the peer checks the flag after posting
+      the position - with barriers between, one of them is certain to see
+      the other's write, so a wakeup is never lost. 
+    * x_sync is not meaningful on a host ring connection, as on a buffered
+      connection. 
+*/
+
+#ifndef __epiphany__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "x_lib_configuration.h"
+#include "x_types.h"
+#include "x_error.h"
+#include "x_connection_internals.h"
+#include "x_transfer_internals.h"
+#include "x_buffered_internals.h"
+#include "x_host_ring_internals.h"
+
+#define XHR_SEGMENT_SIZE  (X_LIB_SECTION_SIZE + X_HOST_RING_AREA_SIZE)
+#define XHR_NAME_LENGTH   (32)
+
+typedef struct {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t sender_waiting;
+    volatile uint32_t receiver_waiting;
+    uint32_t          ring_bytes;
+    uint32_t          reserved;
+    char              ring[];
+} xhr_ring_t;
+
+void * x_host_shared_memory = NULL;
+
+static char              xhr_segment_name[XHR_NAME_LENGTH];
+static x_memory_offset_t xhr_next_ring = X_LIB_SECTION_SIZE;
+
+/* xhr_create_shared_memory
+   xhr_attach_shared_memory
+   xhr_remove_shared_memory
+
+  The segment is named after the process that creates it, and the name
+  is put in that process's environment so that it is inherited by the
+  host tasks that it launches. The segment is removed and unmapped by 
+  x_finalize_application (or when x_initialize_application fails) - it
+  remains mapped by any tasks still running.
+*/
+
+void * xhr_create_shared_memory ()
+{
+    int   fd;
+    void *result;
+
+    snprintf (xhr_segment_name, sizeof(xhr_segment_name), "/x-lib-%d", 
+              (int)getpid());
+    fd = shm_open (xhr_segment_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (ftruncate (fd, XHR_SEGMENT_SIZE) == -1) {
+        close (fd);
+        shm_unlink (xhr_segment_name);
+        return NULL;
+    }
+    result = mmap (NULL, XHR_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    close (fd);
+    if (result == MAP_FAILED) {
+        shm_unlink (xhr_segment_name);
+        return NULL;
+    }
+    setenv (X_HOST_SHM_ENVIRONMENT_VARIABLE, xhr_segment_name, 1);
+    return result;
+}
+
+void * xhr_attach_shared_memory ()
+{
+    const char *name = getenv (X_HOST_SHM_ENVIRONMENT_VARIABLE);
+    int         fd;
+    void       *result;
+
+    if ((name == NULL) || (-1 == (fd = shm_open (name, O_RDWR, 0)))) {
+        return NULL;
+    }
+    result = mmap (NULL, XHR_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    close (fd);
+    return (result == MAP_FAILED) ? NULL : result;
+}
+
+void xhr_remove_shared_memory ()
+{
+    if (xhr_segment_name[0] != '\0') {
+        shm_unlink (xhr_segment_name);
+        xhr_segment_name[0] = '\0';
+    }
+    if (x_host_shared_memory != NULL) {
+        munmap (x_host_shared_memory, XHR_SEGMENT_SIZE);
+        x_host_shared_memory = NULL;
+    }
+    xhr_next_ring = X_LIB_SECTION_SIZE;
+}
+
+/* xhr_alloc_ring
+
+  Rings are allocated upwards from the end of the XLIB section copy, and
+  are never freed - the segment lasts as long as the application. 
+*/
+
+x_memory_offset_t xhr_alloc_ring (uint32_t ring_bytes)
+{
+    x_memory_offset_t result = xhr_next_ring;
+    xhr_ring_t       *ring;
+
+    if ((x_host_shared_memory == NULL) ||
+        (result + sizeof(xhr_ring_t) + ring_bytes > XHR_SEGMENT_SIZE)) {
+        return 0;
+    }
+    ring = (xhr_ring_t*)((char*)x_host_shared_memory + result);
+    memset (ring, 0, sizeof(xhr_ring_t));
+    ring->ring_bytes = ring_bytes;
+    xhr_next_ring += sizeof(xhr_ring_t) + ring_bytes;
+    return result;
+}
+
+void xhr_initialise_endpoint (x_endpoint_t * local_endpoint, 
+                              x_memory_offset_t ring_offset,
+                              x_bool_t sending)
+{
+    xhr_ring_t *ring = (xhr_ring_t*)((char*)x_host_shared_memory + ring_offset);
+
+    local_endpoint->mode              = sending ? X_HOST_RING_SENDING_ENDPOINT :
+                                                  X_HOST_RING_RECEIVING_ENDPOINT;
+    local_endpoint->address_from_peer = ring_offset;
+    local_endpoint->control_from_peer = ring->ring_bytes;
+    local_endpoint->sequence          = 0;
+}
+
+static inline xhr_ring_t * xhr_ring (x_endpoint_t * local_endpoint)
+{
+    return (xhr_ring_t*)((char*)x_host_shared_memory + 
+                         local_endpoint->address_from_peer);
+}
+
+/* Ring position arithmetic, as in x_buffered.c */
+
+static inline x_transfer_sequence_t xhr_advance (x_transfer_sequence_t position,
+                                                 uint32_t bytes,
+                                                 uint32_t ring_bytes)
+{
+    position += bytes;
+    return (position >= 2*ring_bytes) ? position - 2*ring_bytes : position;
+}
+
+static inline uint32_t xhr_offset (x_transfer_sequence_t position,
+                                   uint32_t ring_bytes)
+{
+    return (position >= ring_bytes) ? position - ring_bytes : position;
+}
+
+static inline uint32_t xhr_used (x_transfer_sequence_t head, 
+                                 x_transfer_sequence_t tail,
+                                 uint32_t ring_bytes)
+{
+    return (head >= tail) ? head - tail : head + 2*ring_bytes - tail;
+}
+
+static inline uint32_t xhr_record_bytes (x_transfer_size_t size)
+{
+    return XB_RING_BYTES(sizeof(xhr_record_header_t) + size);
+}
+
+/* xhr_wait_for_change
+   xhr_post
+
+  Block until the position word differs from the given value, and post a
+  new position, waking the peer if it is blocked. The futex is not the 
+  process-private kind since the peer is another process. 
+  Blocking costs two system calls, so the waiter first polls and yields
+  the CPU as in xc_host_backoff, which is enough when the peer is just 
+  about to post. 
+*/
+
+static void xhr_wait_for_change (volatile uint32_t * position, uint32_t value,
+                                 volatile uint32_t * waiting)
+{
+    unsigned polls = 0;
+
+    while (*position == value) {
+        if ((xc_wait_spin_budget == 0) || 
+            (polls < xc_wait_spin_budget + X_HOST_WAIT_YIELDS)) {
+            xc_host_backoff (&polls);
+            continue;
+        }
+        *waiting = 1;
+        atomic_thread_fence (memory_order_seq_cst);
+        if (*position == value) {
+            syscall (SYS_futex, position, FUTEX_WAIT, value, NULL, NULL, 0);
+        }
+        *waiting = 0;
+    }
+}
+
+static void xhr_post (volatile uint32_t * position, uint32_t value,
+                      volatile uint32_t * peer_waiting)
+{
+    atomic_thread_fence (memory_order_seq_cst);
+    *position = value;
+    atomic_thread_fence (memory_order_seq_cst);
+    if (*peer_waiting) {
+        syscall (SYS_futex, position, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+/* xhr_send
+
+  Writes a message into the ring, blocking only if there is not enough 
+  free space in the ring for it. 
+
+  Returns the size of the message, or -1 if the message is too big to 
+  ever fit in the ring. 
+*/
+
+int xhr_send (x_endpoint_t * local_endpoint, const void * buf, 
+              x_transfer_size_t size)
+{
+    xhr_ring_t            *ring = xhr_ring (local_endpoint);
+    x_transfer_sequence_t  head = local_endpoint->sequence, tail;
+    uint32_t               ring_bytes = local_endpoint->control_from_peer;
+    uint32_t               record_bytes = xhr_record_bytes (size);
+    uint32_t               offset, first_part;
+
+    if (size == X_ENDPOINT_SYNC_CONTROL) {
+        return x_error (X_E_INVALID_TRANSFER_SIZE, size, local_endpoint);
+    }
+    if (record_bytes > ring_bytes) {
+        return x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, ring_bytes, 
+                        local_endpoint);
+    }
+    while (ring_bytes - xhr_used (head, (tail = ring->tail), ring_bytes) < 
+           record_bytes) {
+        xhr_wait_for_change (&ring->tail, tail, &ring->sender_waiting);
+    }
+
+    offset = xhr_offset (head, ring_bytes);
+    *((xhr_record_header_t*)(ring->ring + offset)) = size;
+    offset    += sizeof(xhr_record_header_t);
+    first_part = ring_bytes - offset;
+    if (first_part >= size) {
+        xtr_copy (ring->ring + offset, buf, size);
+    }
+    else {
+        xtr_copy (ring->ring + offset, buf, first_part);
+        xtr_copy (ring->ring, (const char*)buf + first_part, size - first_part);
+    }
+
+    head = xhr_advance (head, record_bytes, ring_bytes);
+    local_endpoint->sequence = head;
+    xhr_post (&ring->head, head, &ring->receiver_waiting);
+    xc_ring_doorbell (local_endpoint);
+    return size;
+}
+
+/* xhr_receive
+
+  Takes the next message out of the ring, blocking until one arrives if
+  the ring is empty. 
+
+  Returns the size of the message, or -1 if the message is bigger than
+  the supplied buffer - in which case the message is left in the ring. 
+*/
+
+int xhr_receive (x_endpoint_t * local_endpoint, void * buf, 
+                 x_transfer_size_t size)
+{
+    xhr_ring_t            *ring = xhr_ring (local_endpoint);
+    x_transfer_sequence_t  tail = local_endpoint->sequence;
+    uint32_t               ring_bytes = local_endpoint->control_from_peer;
+    uint32_t               offset, first_part;
+    xhr_record_header_t    message_size;
+
+    xhr_wait_for_change (&ring->head, tail, &ring->receiver_waiting);
+    atomic_thread_fence (memory_order_seq_cst);
+
+    offset       = xhr_offset (tail, ring_bytes);
+    message_size = *((xhr_record_header_t*)(ring->ring + offset));
+    if (message_size > size) {
+        return x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, message_size, 
+                        local_endpoint);
+    }
+    offset    += sizeof(xhr_record_header_t);
+    first_part = ring_bytes - offset;
+    if (first_part >= message_size) {
+        xtr_copy (buf, ring->ring + offset, message_size);
+    }
+    else {
+        xtr_copy (buf, ring->ring + offset, first_part);
+        xtr_copy ((char*)buf + first_part, ring->ring, message_size - first_part);
+    }
+
+    tail = xhr_advance (tail, xhr_record_bytes (message_size), ring_bytes);
+    local_endpoint->sequence = tail;
+    xhr_post (&ring->tail, tail, &ring->sender_waiting);
+    xc_ring_doorbell (local_endpoint);
+    return message_size;
+}
+
+/* xhr_ready
+
+  As for buffered connections, a sender is ready when the ring is not 
+  full, and a receiver when there is at least one message in the ring. 
+*/
+
+x_bool_t xhr_ready (x_endpoint_t * local_endpoint)
+{
+    xhr_ring_t *ring = xhr_ring (local_endpoint);
+    uint32_t    ring_bytes = local_endpoint->control_from_peer;
+
+    if (local_endpoint->mode == X_HOST_RING_SENDING_ENDPOINT) {
+        return (xhr_used (local_endpoint->sequence, ring->tail, ring_bytes) < 
+                ring_bytes);
+    }
+    else {
+        return (ring->head != local_endpoint->sequence);
+    }
+}
+
+#endif /* __epiphany__ */
@@ -0,0 +1,158 @@
+/*
+File: x_mutex.c
+
+Copyright 2013 Mark Honman
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+#include <stdint.h>
+#include "x_lib_configuration.h"
+#include "x_types.h"
+#include "x_error.h"
+#include "x_task.h"
+#include "x_mutex.h"
+#include "x_application_internals.h"
+#include "x_transfer_internals.h"
+#include "x_connection_internals.h"
+
+#ifndef __epiphany__
+#include <stdatomic.h>
+#endif
+
+/* xm_try_lock
+
+  A single attempt to take the mutex, returning TRUE if successful. 
+
+  On the Epiphany, TESTSET writes the owner value to the (global) address
+  if the word there is zero, and always returns the previous contents. 
+*/
+
+static inline x_bool_t xm_try_lock (x_mutex_t *mutex, uint32_t owner)
+{
+#ifdef __epiphany__
+    uint32_t *global_mutex = (uint32_t*)xtr_global_address ((void*)mutex);
+    uint32_t  offset = 0;
+
+    __asm__ __volatile__ ("testset %[value], [%[address], %[offset]]"
+                          : [value] "+r" (owner)
+                          : [address] "r" (global_mutex), [offset] "r" (offset)
+                          : "memory");
+    return (owner == 0);
+#else
+    uint32_t expected = 0;
+
+    return atomic_compare_exchange_strong_explicit (
+                   (_Atomic uint32_t*)mutex, &expected, owner,
+                   memory_order_acquire, memory_order_relaxed);
+#endif
+}
+
+/* xm_delay
+
+  Busy-waits for roughly the given number of loop iterations. 
+*/
+
+static void xm_delay (unsigned iterations)
+{
+    volatile unsigned i;
+
+    for (i = 0; i < iterations; i++) {
+    }
+}
+
+void x_mutex_init (x_mutex_t *mutex)
+{
+    *mutex = 0;
+}
+
+/* x_mutex_lock
+
+  Test-and-test-and-set: after a failed attempt, the word is only read
+  until it is seen to be free, since a read is cheaper for the mesh than
+  a TESTSET. 
+
+  On the Epiphany a mutex in shared DRAM is rejected, since TESTSET does
+  not work there and the lock would give no exclusion. 
+  A host task waiting for the mutex backs off as in xc_host_backoff, 
+  whatever the options. 
+*/
+
+x_return_stat_t x_mutex_lock (x_mutex_t *mutex, int options)
+{
+    uint32_t       owner = (uint32_t)x_get_task_id() + 1;
+    unsigned       backoff = X_MUTEX_MIN_BACKOFF;
+    x_task_state_t previous_state;
+#ifndef __epiphany__
+    unsigned       polls = 0;
+#endif
+
+    if (mutex == NULL) {
+        return x_error (X_E_NULL_MUTEX, 0, NULL);
+    }
+#ifdef __epiphany__
+    if ((xtr_global_address ((void*)mutex) >> 25) == 
+        (X_EPIPHANY_SHARED_DRAM_BASE >> 25)) {
+        return x_error (X_E_MUTEX_NOT_IN_CORE_MEMORY, 0, (void*)mutex);
+    }
+#endif
+    if (xm_try_lock (mutex, owner)) {
+        return X_SUCCESS;
+    }
+    previous_state = xt_set_task_state (X_MUTEX_WAITING_TASK);
+    do {
+        if (options & X_MUTEX_BACKOFF) {
+            xm_delay (backoff);
+            if (backoff < X_MUTEX_MAX_BACKOFF) {
+                backoff <<= 1;
+            }
+        }
+        while (*mutex != 0) {
+#ifdef __epiphany__
+            if (options & X_MUTEX_BACKOFF) {
+                xm_delay (backoff);
+            }
+#else
+            xc_host_backoff (&polls);
+#endif
+        }
+    } while (!xm_try_lock (mutex, owner));
+    xt_set_task_state (previous_state);
+    return X_SUCCESS;
+}
+
+/* x_mutex_unlock
+
+  Only the owner can release the mutex. 
+*/
+
+x_return_stat_t x_mutex_unlock (x_mutex_t *mutex)
+{
+    uint32_t owner = (uint32_t)x_get_task_id() + 1;
+
+    if (mutex == NULL) {
+        return x_error (X_E_NULL_MUTEX, 0, NULL);
+    }
+    if (*mutex != owner) {
+        return x_error (X_E_MUTEX_NOT_OWNED, *mutex, (void*)mutex);
+    }
+#ifdef __epiphany__
+    *mutex = 0;
+#else
+    atomic_store_explicit ((_Atomic uint32_t*)mutex, 0, memory_order_release);
+#endif
+    return X_SUCCESS;
+}
@@ -27,7 +27,13 @@ see the files COPYING and COPYING.LESSER. If not, see
 #include "x_endpoint.h"
 #include "x_sync.h"
 #include "x_connection_internals.h"
+#include "x_transfer_internals.h"
+#include "x_buffered_internals.h"
+#include "x_host_ring_internals.h"
+#include "x_application_internals.h"
+#include "x_exchange.h"
 #include "x_task.h"
+#include "x_address.h"
 
 /* x_sync
 
@@ -81,7 +87,8 @@ x_return_stat_t x_sync (x_endpoint_handle_t endpoint)
     
     remote_endpoint->control_from_peer = X_ENDPOINT_SYNC_CONTROL;
     remote_endpoint->sequence_from_peer = new_sequence;
-    while (local_endpoint->sequence_from_peer != new_sequence) { } ;
+    xc_ring_doorbell (local_endpoint);
+    xc_wait_for_sequence (local_endpoint, &local_endpoint->sequence_from_peer, new_sequence);
     control_from_peer = local_endpoint->control_from_peer;
     local_endpoint->sequence = new_sequence;
     if (control_from_peer != X_ENDPOINT_SYNC_CONTROL) {
@@ -92,6 +99,283 @@ x_return_stat_t x_sync (x_endpoint_handle_t endpoint)
     }
 }
 
+/* xs_send
+   xs_receive
+
+  The rendezvous transfer protocol, shared by the plain and vector forms
+  of send and receive. These are inlined so that the plain forms do not 
+  pay for the generality - when iov and layout are NULL the vector and
+  strided code drops out. The part after the peer's offer has arrived is
+  in xs_send_offered and xs_receive_offered, which the inline forms in 
+  x_sync_inline.h also use. 
+
+  xs_send transfers from the segment list or strided layout if one is 
+  given, otherwise from buf. xs_receive posts the given address and control word to the sender,
+  and checks the size offered by the sender against receive_size. 
+  buf is the plain buffer into which the data from a pull sender (a host
+  task) are fetched, or NULL for the vector and strided forms, which do 
+  not support pull senders. 
+  See x_sync_send and x_sync_receive for the algorithms. 
+*/
+
+static inline int xs_send_offered (x_endpoint_t * local_endpoint, 
+                                   const void * buf, x_transfer_size_t size, 
+                                   const x_iovec_t * iov, int iovcnt,
+                                   const x_stride_t * layout,
+                                   x_transfer_sequence_t new_sequence)
+{
+    int                            result = -1;
+    x_endpoint_t                  *remote_endpoint = local_endpoint->remote_endpoint;
+    x_transfer_control_t           size_from_peer  = local_endpoint->control_from_peer;
+    x_transfer_control_t           transferred = X_ENDPOINT_SYNC_CONTROL;
+
+    local_endpoint->sequence = new_sequence;
+    if (size == X_ENDPOINT_SYNC_CONTROL) {
+        x_error (X_E_INVALID_TRANSFER_SIZE, size, local_endpoint);
+    }
+    else if (size_from_peer == X_ENDPOINT_SYNC_CONTROL) {
+        x_error (X_E_SYNC_TRANSFER_MISMATCH, size_from_peer, local_endpoint);
+    }        
+    else if (size_from_peer < size) {
+        x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, size_from_peer, local_endpoint);
+    }
+    else if ((iov == NULL) && (layout == NULL) && 
+             !(size_from_peer & X_ENDPOINT_CONTROL_FLAGS)) {
+        xtr_transfer ((void*)local_endpoint->address_from_peer, buf, size);
+        transferred = size;
+        result      = size;
+    }    
+    else if (0 <= xtr_special_transfer (buf, size, iov, iovcnt, layout,
+                                        local_endpoint->address_from_peer,
+                                        size_from_peer)) {
+        transferred = size;
+        result      = size;
+    }
+    remote_endpoint->transferred_from_peer = transferred;
+    remote_endpoint->completed_from_peer   = new_sequence;
+    xc_wake_peer (local_endpoint);
+    return result;
+}
+
+static inline int xs_send (x_endpoint_t * local_endpoint, const void * buf, 
+                           x_transfer_size_t size, 
+                           const x_iovec_t * iov, int iovcnt,
+                           const x_stride_t * layout)
+{
+    x_endpoint_t                  *remote_endpoint = local_endpoint->remote_endpoint;
+    register x_transfer_sequence_t new_sequence = (local_endpoint->sequence + 1);
+
+    remote_endpoint->address_from_peer  = xtr_global_address (buf);
+    remote_endpoint->control_from_peer  = size;
+    remote_endpoint->sequence_from_peer = new_sequence;
+    xc_ring_doorbell (local_endpoint);
+
+    xc_wait_for_sequence (local_endpoint, &local_endpoint->sequence_from_peer, new_sequence);
+    return xs_send_offered (local_endpoint, buf, size, iov, iovcnt, layout, 
+                            new_sequence);
+}
+
+static inline int xs_receive_offered (x_endpoint_t * local_endpoint, 
+                                      x_transfer_size_t receive_size,
+                                      void * buf,
+                                      x_transfer_sequence_t new_sequence)
+{
+    int                            result = -1;
+    x_transfer_control_t           size_from_peer = local_endpoint->control_from_peer;
+    x_bool_t                       peer_completed;
+
+    peer_completed = (local_endpoint->completed_from_peer == new_sequence);
+    local_endpoint->sequence = new_sequence;
+    if (receive_size == X_ENDPOINT_SYNC_CONTROL) {
+        x_error (X_E_INVALID_TRANSFER_SIZE, receive_size, local_endpoint);
+    }
+    else if (!peer_completed && (size_from_peer == X_ENDPOINT_SYNC_CONTROL)) {
+        x_error (X_E_SYNC_TRANSFER_MISMATCH, size_from_peer, local_endpoint);
+    }        
+    else if (!peer_completed && (size_from_peer > receive_size)) {
+        if ((size_from_peer & X_ENDPOINT_PULL_CONTROL) && (buf != NULL) &&
+            ((size_from_peer & ~X_ENDPOINT_PULL_CONTROL) <= receive_size)) {
+            result = xtr_pull (local_endpoint, buf, 
+                               size_from_peer & X_ENDPOINT_SIZE_MASK, new_sequence);
+        }
+        else {
+            x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, size_from_peer, local_endpoint);
+        }
+    }
+    else {
+        xc_wait_for_sequence (local_endpoint, &local_endpoint->completed_from_peer, new_sequence);
+        size_from_peer = local_endpoint->transferred_from_peer;
+        if (size_from_peer == X_ENDPOINT_SYNC_CONTROL) {
+            x_error (X_E_SYNC_TRANSFER_MISMATCH, size_from_peer, local_endpoint);
+        }
+        else {
+            result = size_from_peer;
+        }
+    }    
+    return result;
+}
+
+static inline int xs_receive (x_endpoint_t * local_endpoint, 
+                              x_transfer_address_t address,
+                              x_transfer_control_t control,
+                              x_transfer_size_t    receive_size,
+                              void               * buf)
+{
+    x_endpoint_t                  *remote_endpoint = local_endpoint->remote_endpoint;
+    register x_transfer_sequence_t new_sequence = (local_endpoint->sequence + 1);
+
+    remote_endpoint->address_from_peer  = address;
+    remote_endpoint->control_from_peer  = control;
+    remote_endpoint->sequence_from_peer = new_sequence;
+    xc_ring_doorbell (local_endpoint);
+
+    xc_wait_for_sequence (local_endpoint, &local_endpoint->sequence_from_peer, new_sequence);
+    return xs_receive_offered (local_endpoint, receive_size, buf, new_sequence);
+}
+
+/* xs_inline_send_offered
+   xs_inline_receive_offered
+
+  The out-of-line part of x_sync_send_inline and x_sync_receive_inline 
+  (x_sync_inline.h), called once the peer's offer has arrived when it is
+  not one that the inline code handles itself. 
+*/
+
+int xs_inline_send_offered (x_endpoint_t * local_endpoint, const void * buf, 
+                            x_transfer_size_t size, 
+                            x_transfer_sequence_t new_sequence)
+{
+    return xs_send_offered (local_endpoint, buf, size, NULL, 0, NULL, 
+                            new_sequence);
+}
+
+int xs_inline_receive_offered (x_endpoint_t * local_endpoint, 
+                               x_transfer_size_t receive_size, void * buf,
+                               x_transfer_sequence_t new_sequence)
+{
+    return xs_receive_offered (local_endpoint, receive_size, buf, new_sequence);
+}
+
+/* xs_multicast_send
+
+  Sends the same buffer to every receiver of a multicast connection, 
+  whose endpoints follow the head endpoint. This is simply an exchange 
+  with an element per receiver: all of the offers are posted first, and
+  the data copied to each receiver in turn as it becomes ready. 
+  The number of receivers is kept in the head endpoint, so that nothing
+  is read from the connection list in DRAM. 
+*/
+
+static int xs_multicast_send (x_endpoint_t * head, const void * buf,
+                              x_transfer_size_t size)
+{
+    uint64_t          list_storage[(X_EXCHANGE_LIST_SIZE(X_MULTICAST_MAX_RECEIVERS)+7)/8];
+    x_exchange_list_t list = (x_exchange_list_t)list_storage;
+    int               i;
+
+    x_init_exchange_list (list, head->num_receivers);
+    for (i = 0; i < head->num_receivers; i++) {
+        x_add_exchange_element (list, head + i, (void*)buf, size);
+    }
+    if (x_sync_exchange (list) == X_ERROR) {
+        return X_ERROR;
+    }
+    return size;
+}
+
+/* xs_host_send
+   xs_host_receive
+
+  The transfer protocol for host tasks, whose endpoints and staging 
+  buffers are in shared DRAM (see x_application_internals.h). 
+
+  A host sender copies the data into its staging buffer and offers that
+  with the pull flag set, so that the receiver fetches the data itself -
+  an Epiphany receiver does so with its DMA engine, which is much faster
+  than the host writing into core memory through the mapped window. The
+  checks on the receiver's offer are those of xs_send, and the receiver 
+  makes the same decision in xs_receive. Once accepted, the sender waits
+  for the receiver to complete the transfer, since the staging buffer is
+  needed for the next one. 
+
+  A host receiver offers its staging buffer, into which an Epiphany sender
+  copies (or DMAs) the data as usual, and then copies the data to the
+  caller's buffer. Transfers between two host tasks are pulled from one
+  staging buffer into the other. 
+
+  Notes:
+    * Only plain transfers are supported: the vector, strided, large, 
+      zero-copy, multicast and buffered forms, and exchanges, are for 
+      Epiphany tasks, and fail the mode check on the host (see 
+      xc_core_endpoint_mode). 
+    * Connections between two host tasks do not come this way, see 
+      x_host_ring.c. 
+    * On a host sending endpoint the completion words are written by the
+      receiver, unlike on an Epiphany sending endpoint where they are 
+      unused. 
+*/
+
+#ifndef __epiphany__
+
+static int xs_host_send (x_endpoint_t * local_endpoint, const void * buf, 
+                         x_transfer_size_t size)
+{
+    x_endpoint_t                  *remote_endpoint = local_endpoint->remote_endpoint;
+    x_transfer_sequence_t          new_sequence = (local_endpoint->sequence + 1);
+    void                          *staging = xt_host_staging_buffer (local_endpoint);
+    x_transfer_control_t           size_from_peer;
+
+    if (size != X_ENDPOINT_SYNC_CONTROL) {
+        xtr_copy (staging, buf, size);
+    }
+    remote_endpoint->address_from_peer  = (x_transfer_address_t)(uintptr_t)
+                                          x_host_to_epiphany_shared_memory_address (staging);
+    remote_endpoint->control_from_peer  = (size == X_ENDPOINT_SYNC_CONTROL) ?
+                                          X_ENDPOINT_SYNC_CONTROL :
+                                          (X_ENDPOINT_PULL_CONTROL | size);
+    remote_endpoint->sequence_from_peer = new_sequence;
+    xc_ring_doorbell (local_endpoint);
+
+    xc_wait_for_sequence (local_endpoint, &local_endpoint->sequence_from_peer, new_sequence);
+    size_from_peer = local_endpoint->control_from_peer;
+    local_endpoint->sequence = new_sequence;
+    if (size == X_ENDPOINT_SYNC_CONTROL) {
+        x_error (X_E_INVALID_TRANSFER_SIZE, size, local_endpoint);
+    }
+    else if ((size_from_peer == X_ENDPOINT_SYNC_CONTROL) ||
+             (size_from_peer & X_ENDPOINT_CONTROL_FLAGS)) {
+        x_error (X_E_SYNC_TRANSFER_MISMATCH, size_from_peer, local_endpoint);
+    }        
+    else if (size_from_peer < size) {
+        x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, size_from_peer, local_endpoint);
+    }
+    else {
+        xc_wait_for_sequence (local_endpoint, &local_endpoint->completed_from_peer, new_sequence);
+        return local_endpoint->transferred_from_peer;
+    }
+    remote_endpoint->transferred_from_peer = X_ENDPOINT_SYNC_CONTROL;
+    remote_endpoint->completed_from_peer   = new_sequence;
+    return -1;
+}
+
+static int xs_host_receive (x_endpoint_t * local_endpoint, void * buf, 
+                            x_transfer_size_t size)
+{
+    void *staging = xt_host_staging_buffer (local_endpoint);
+    int   result;
+
+    result = xs_receive (local_endpoint, 
+                         (x_transfer_address_t)(uintptr_t)
+                         x_host_to_epiphany_shared_memory_address (staging),
+                         size, size, staging);
+    if (result > 0) {
+        xtr_copy (buf, staging, result);
+    }
+    return result;
+}
+
+#endif /* __epiphany__ */
+
 /* x_sync_send
 
   Synchronous communication, sender side. 
@@ -106,11 +390,17 @@ x_return_stat_t x_sync (x_endpoint_handle_t endpoint)
   Error conditions:
     The specified endpoint is not a Sending endpoint. 
 
+  Buffered connections are handled by xb_send (x_buffered.c), which returns
+  as soon as the message is in the receiver's ring buffer, and multicast
+  connections by xs_multicast_send. The tests for these are inside the
+  mode-mismatch branch so that they cost nothing in the rendezvous case. 
+  Host tasks use xs_host_send, except on connections to other host tasks
+  which go through a ring in host shared memory (xhr_send, x_host_ring.c).
+
   Global references: 
     The coreid bits that are needed to transform local into global addresses
       are picked up from x_global_address_local_coreid_bits.
 
-
   Algorithm:
     Synchronise with the receiver; transmitting transfer size and local
       buffer address (the latter for info only) and receiving destination
@@ -119,24 +409,28 @@ x_return_stat_t x_sync (x_endpoint_handle_t endpoint)
       sync flag, exit with an appropriate error. 
     Otherwise if there is data to be transferred
       Transfer the data to the peer's destination buffer. 
-      Synchronise again with the receiver to indicate completion of the
-        transfer.
+    Post the size transferred (the sync flag if there was an error) and 
+      then the sequence number to the receiver's completion words, and 
+      return without waiting for the receiver. 
         
   Notes:
     * Conversion of local to global addresses is required (not strictly
       requred in the sender, but 
     * The receiver is expected to perform the same checks on the control
       word, thus the peers make the same decision as to whether the
-      second synchronisation is performed. 
+      transfer is performed. 
     * The size could be sanity-checked to ensure that is positive. 
-    * The second sync with the receiver is needed so that the receiver can
-      be informed of transfer completion while avoiding race conditions. 
-      An alternative would be to introduce yet another coordination flag
-      in the endpoint that would hold the sequence number of the last 
-      completed transfer. TEST PERFORMANCE of this alternative!
-    * The potential race condition described in the x_sync comments should
-      not arise because of the second sync - provided that the control and
-      address values written to the peer are left unaltered. 
+    * Earlier versions did a second sync with the receiver to inform it 
+      of transfer completion. The completion words do the same job with
+      two posted writes and no round trip - see sync_send_latency_test in
+      e_messaging_test.c. 
+    * Since the sender does not wait for the receiver after the transfer,
+      it may post its next offer before the receiver has seen this one.
+      The receiver allows for this, see x_sync_receive. 
+    * The transferred size is posted even though the receiver saw the 
+      size in the offer, because the offer may have been overwritten by
+      then. It also tells the receiver whether the sender abandoned the
+      transfer. 
     * it is hard to believe, but masking in the global_address_local_coreid
       bits costs 12 cycles over and above the cost of writing the address
       to the other core. On the other hand the assembly approach used in
@@ -144,142 +438,40 @@ x_return_stat_t x_sync (x_endpoint_handle_t endpoint)
     * It is slightly faster to test whether an address is global by shifting 
       it right 20 bits, than using a bitmask.     
 
-  Data transfer (copying) logic - the reasoning
-    * Epiphany multibyte load/store instructions require that data be aligned
-      in memory according to data size. 
-    * For sub-optimal start and end offsets, it is possible to ramp up to
-      doubleword transfers, and ramp down at the end. 
-    * When the source and destination addresses have different alignments,
-      this limits the biggest load/store operation size.
-      
-  Data copying algorithm:
-    Since there are a lot of cases to check, the tests are structured to
-    favour the most common case, word-aligned data (which may turn out to be
-    doubleword-aligned, but due to the absence of double precision floating
-    point support, naturally doubleword-aligned data are rare). 
-    Doing too many tests increases the overhead, limiting the benefits of
-    special-case coding. 
-    
-    If send and receive buffers are word-aligned
-       If size is >= 32 and both buffers have the same even or odd word 
-       alignment, a doubleword transfer is worthwhile
-         If both buffer addresses are not doubleword-aligned
-           Copy the first word
-         while size remaining >= 32 
-           Copy double words in a 4x unrolled loop
-       while size remaining >= 16
-           Copy words in a 4x unrolled loop
-       while size remaining >= 4
-           Copy a word
-       for size remaining 
-           Copy a byte
-    Else (buffers not word-aligned) 
-      While size remaining >= 8
-         Copy bytes in an 8x unrolled loop
-      for size remaining
-         copy a byte
+  Data transfer (copying) logic
+    * The copy is done by xtr_transfer (x_transfer_internals.h), which is
+      inlined so that small transfers do not pay for another call. See
+      that file for the reasoning behind the copying algorithm.
+    * Transfers that are at least as large as the DMA threshold for their
+      alignment class are done by the DMA engine - for throughput the
+      DMA engine wins above about 152 bytes for byte-aligned buffers, 
+      704 for word-aligned and 1408 for doubleword-aligned.
 */
 
 int x_sync_send (x_endpoint_handle_t endpoint, const void * buf, 
                  x_transfer_size_t size)
 {
-    int                            result = -1;
-    x_endpoint_t                  *local_endpoint  = (x_endpoint_t*) endpoint;
-    x_endpoint_t                  *remote_endpoint = local_endpoint->remote_endpoint;
-    register x_transfer_sequence_t new_sequence = (local_endpoint->sequence + 1);
-    x_transfer_control_t           size_from_peer;
+    x_endpoint_t *local_endpoint = (x_endpoint_t*) endpoint;
 
     if (local_endpoint->mode != X_SENDING_ENDPOINT) {
-        x_error (X_E_ENDPOINT_MODE_MISMATCH, 0, endpoint);
-    }
-    else {
-        if ((((x_transfer_address_t)buf) >> 20) == 0) {
-            remote_endpoint->address_from_peer = 
-                ((x_transfer_address_t)buf) | x_global_address_local_coreid_bits; 
+        if (local_endpoint->mode == X_BUFFERED_SENDING_ENDPOINT) {
+            return xb_send (local_endpoint, buf, size);
         }
-        else {
-            remote_endpoint->address_from_peer = (x_transfer_address_t)buf;
-        }
-        remote_endpoint->control_from_peer  = size;
-        remote_endpoint->sequence_from_peer = new_sequence;
-
-        while (local_endpoint->sequence_from_peer != new_sequence) { } ;
-        size_from_peer = local_endpoint->control_from_peer;
-        local_endpoint->sequence = new_sequence;
-        if (size == X_ENDPOINT_SYNC_CONTROL) {
-            x_error (X_E_INVALID_TRANSFER_SIZE, size, endpoint);
+        if (local_endpoint->mode == X_MULTICAST_SENDING_ENDPOINT) {
+            return xs_multicast_send (local_endpoint, buf, size);
         }
-        else if (size_from_peer == X_ENDPOINT_SYNC_CONTROL) {
-            x_error (X_E_SYNC_TRANSFER_MISMATCH, size_from_peer, endpoint);
-        }        
-        else if (size_from_peer < size) {
-            x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, size_from_peer, endpoint);
+#ifndef __epiphany__
+        if (local_endpoint->mode == X_HOST_RING_SENDING_ENDPOINT) {
+            return xhr_send (local_endpoint, buf, size);
         }
-        else {
-//            if ( size < X_MESSAGING_MIN_DMA_SIZE ) {
-//               e_dma_copy((void*)local_endpoint->address_from_peer, buf, size);
-            register char * src_ptr  = (char*)buf;
-            register char * dest_ptr = (char*)local_endpoint->address_from_peer;
-            register char * after_end_ptr  = dest_ptr + size;
-            if ((((uint32_t)buf | (uint32_t)local_endpoint->address_from_peer) & 0x3) == 0) {
-                // Word-aligned happy zone, maybe doubleword transfers can be done
-                if ((size >= 32) && 
-                    ((((uint32_t)src_ptr ^ (uint32_t)dest_ptr) & 0x4) == 0)) {
-                    if ((uint32_t)dest_ptr & 0x4) {
-                        *((uint32_t*)dest_ptr) = *((uint32_t*)src_ptr);
-                        src_ptr  += 4;
-                        dest_ptr += 4;
-                    }
-                    while (after_end_ptr - dest_ptr >= 32) {
-                        *((uint64_t*)dest_ptr)   = *((uint64_t*)src_ptr);
-                        *((uint64_t*)dest_ptr+1) = *((uint64_t*)src_ptr+1);
-                        *((uint64_t*)dest_ptr+2) = *((uint64_t*)src_ptr+2);
-                        *((uint64_t*)dest_ptr+3) = *((uint64_t*)src_ptr+3);
-                        src_ptr  += 32;
-                        dest_ptr += 32;
-                    }
-                }
-                while (after_end_ptr - dest_ptr >= 16) {
-                    *((uint32_t*)dest_ptr)   = *((uint32_t*)src_ptr);
-                    *((uint32_t*)dest_ptr+1) = *((uint32_t*)src_ptr+1);
-                    *((uint32_t*)dest_ptr+2) = *((uint32_t*)src_ptr+2);
-                    *((uint32_t*)dest_ptr+3) = *((uint32_t*)src_ptr+3);
-                    src_ptr  += 16;
-                    dest_ptr += 16;
-                }
-                while (after_end_ptr - dest_ptr >= 4) {
-                    *((uint32_t*)dest_ptr) = *((uint32_t*)src_ptr);
-                    src_ptr  += 4;
-                    dest_ptr += 4;
-                }
-                while (after_end_ptr - dest_ptr >= 1) {
-                    *dest_ptr++ = *src_ptr++;
-                }
-            }
-            else {
-                // not word-aligned, do the best possible with bytewise copy
-                while (after_end_ptr - dest_ptr >= 8) {
-                    *dest_ptr++ = *src_ptr++;
-                    *dest_ptr++ = *src_ptr++;
-                    *dest_ptr++ = *src_ptr++;
-                    *dest_ptr++ = *src_ptr++;
-                    *dest_ptr++ = *src_ptr++;
-                    *dest_ptr++ = *src_ptr++;
-                    *dest_ptr++ = *src_ptr++;
-                    *dest_ptr++ = *src_ptr++;
-                }
-                while (after_end_ptr - dest_ptr >= 1) {
-                    *dest_ptr++ = *src_ptr++;
-                }
-            }  
-            new_sequence++;
-            remote_endpoint->sequence_from_peer = new_sequence;
-            while (local_endpoint->sequence_from_peer != new_sequence) { } ;
-            local_endpoint->sequence = new_sequence;
-            result = size;
-        }    
+#endif
+        return x_error (X_E_ENDPOINT_MODE_MISMATCH, 0, endpoint);
     }
-    return result;
+#ifdef __epiphany__
+    return xs_send (local_endpoint, buf, size, NULL, 0, NULL);
+#else
+    return xs_host_send (local_endpoint, buf, size);
+#endif
 }
 
 /* x_sync_receive
@@ -294,6 +486,10 @@ int x_sync_send (x_endpoint_handle_t endpoint, const void * buf,
   Error conditions:
     The specified endpoint is not a Receiving endpoint. 
 
+  Buffered connections are handled by xb_receive (x_buffered.c), and
+  host tasks use xs_host_receive - or xhr_receive (x_host_ring.c) on a
+  connection from another host task. 
+
   Global references: 
     The coreid bits that are needed to transform local into global addresses
       are picked up from x_global_address_local_coreid_bits.
@@ -302,63 +498,440 @@ int x_sync_send (x_endpoint_handle_t endpoint, const void * buf,
     check endpoint mode.
     write size and global address of destination buffer to receiver status 
       in peer's endpoint
-    synchronise with the sender - after this syncronisation the control word
-      and address sent by the peer are valid and the transfer size in the 
-      control word can be validated against the size of the destination area.
+    wait for the sender's offer - after this the control word and address
+      sent by the peer are valid and the transfer size in the control word
+      can be validated against the size of the destination area. 
     If the destination buffer is too small, or the control value is a
       sync flag, exit with an appropriate error. 
-    Otherwise if there is data to be transferred
-      synchronise again with the sender - this will only occur once the
-        sender has completed the transfer. 
-
-  Notes: the sender is expected to perform the transfer, as writing from one
-    core to another is faster than reading. 
-
+    Otherwise wait for the sender to post the completion sequence number,
+      and pick up the size actually transferred. 
+
+  Notes: 
+    * the sender is expected to perform the transfer, as writing from one
+      core to another is faster than reading. The exception is a host 
+      sender, which sets the pull flag in its offer so that the receiver
+      fetches the data from DRAM, see xs_host_send. 
+    * A sender that has completed the transfer does not wait for the 
+      receiver, and may already have posted its next offer - so the 
+      sequence number from the peer may be beyond the one expected. In 
+      that case the control word belongs to the next transfer and is not
+      checked; the completion words say all that is needed. 
 */
 
 int x_sync_receive (x_endpoint_handle_t endpoint, void * buf, 
                     x_transfer_size_t size)
+{
+    x_endpoint_t *local_endpoint = (x_endpoint_t*) endpoint;
+
+    if (local_endpoint->mode != X_RECEIVING_ENDPOINT) {
+        if (local_endpoint->mode == X_BUFFERED_RECEIVING_ENDPOINT) {
+            return xb_receive (local_endpoint, buf, size);
+        }
+#ifndef __epiphany__
+        if (local_endpoint->mode == X_HOST_RING_RECEIVING_ENDPOINT) {
+            return xhr_receive (local_endpoint, buf, size);
+        }
+#endif
+        return x_error (X_E_ENDPOINT_MODE_MISMATCH, 0, endpoint);
+    }
+#ifdef __epiphany__
+    return xs_receive (local_endpoint, xtr_global_address (buf), size, size, buf);
+#else
+    return xs_host_receive (local_endpoint, buf, size);
+#endif
+}
+
+/* x_sync_sendv
+   x_sync_receivev
+
+  Scatter/gather forms of x_sync_send and x_sync_receive. The segments
+  are transferred under a single handshake, and either peer may use the
+  plain or the vector form. 
+
+  Algorithm:
+    As for x_sync_send and x_sync_receive, except that 
+    * A vector receiver posts the global address of its segment list 
+      rather than of a buffer, and flags this in the control word along
+      with the number of segments and their total size. 
+    * The sender reads the receiver's segment list and copies each piece
+      with xtr_transfer, see xtr_vector_transfer in x_transfer.c. 
+    * A vector sender posts the total size of its segments and the 
+      address of the first, so the receiver cannot tell that the data
+      came from several segments. 
+
+  Notes:
+    * Buffered connections are not supported. 
+    * The segment list read by the sender is in the receiver's memory, so
+      it should be short - each segment costs a couple of remote reads.
+*/
+
+int x_sync_sendv (x_endpoint_handle_t endpoint, const x_iovec_t * iov, 
+                  int iovcnt)
+{
+    x_endpoint_t *local_endpoint = (x_endpoint_t*) endpoint;
+    uint32_t      total = 0;
+    int           i;
+
+    if (!xc_core_endpoint_mode (local_endpoint, X_SENDING_ENDPOINT)) {
+        return x_error (X_E_ENDPOINT_MODE_MISMATCH, 0, endpoint);
+    }
+    for (i = 0; i < iovcnt; i++) {
+        total += iov[i].size;
+    }
+    if ((iovcnt <= 0) || (total > X_ENDPOINT_SIZE_MASK)) {
+        total = X_ENDPOINT_SYNC_CONTROL;   // flagged as an error after synchronising
+    }
+    return xs_send (local_endpoint, (iovcnt > 0) ? iov[0].base : NULL, 
+                    total, iov, iovcnt, NULL);
+}
+
+int x_sync_receivev (x_endpoint_handle_t endpoint, const x_iovec_t * iov, 
+                     int iovcnt)
+{
+    x_endpoint_t *local_endpoint = (x_endpoint_t*) endpoint;
+    uint32_t      total = 0;
+    int           i;
+
+    if (!xc_core_endpoint_mode (local_endpoint, X_RECEIVING_ENDPOINT)) {
+        return x_error (X_E_ENDPOINT_MODE_MISMATCH, 0, endpoint);
+    }
+    for (i = 0; i < iovcnt; i++) {
+        total += iov[i].size;
+    }
+    if ((iovcnt <= 0) || (iovcnt > X_ENDPOINT_MAX_SEGMENTS) || 
+        (total > X_ENDPOINT_SIZE_MASK)) {
+        return xs_receive (local_endpoint, 0, X_ENDPOINT_SYNC_CONTROL, 
+                           X_ENDPOINT_SYNC_CONTROL, NULL);
+    }
+    return xs_receive (local_endpoint, xtr_global_address (iov),
+                       X_ENDPOINT_VECTOR_CONTROL | 
+                       (iovcnt << X_ENDPOINT_SEGMENT_COUNT_SHIFT) | total,
+                       total, NULL);
+}
+
+/* x_sync_send_strided
+   x_sync_receive_strided
+
+  Strided forms of x_sync_send and x_sync_receive. 
+
+  A strided receiver posts the global address of its layout descriptor,
+  flagged as such in the control word along with the total size. The 
+  sender reads the descriptor and does the copy, see xtr_strided_transfer
+  in x_transfer.c. A strided sender posts its total size and base 
+  address, so the receiver need not know that the source was strided. 
+
+  Errors are reported after synchronising with the peer, as for the
+  plain forms. 
+*/
+
+static uint32_t xs_layout_size (const x_stride_t * layout)
+{
+    return (uint32_t)layout->element_size * layout->inner_count * 
+           layout->outer_count;
+}
+
+int x_sync_send_strided (x_endpoint_handle_t endpoint, const x_stride_t * layout)
+{
+    x_endpoint_t *local_endpoint = (x_endpoint_t*) endpoint;
+    uint32_t      total = xs_layout_size (layout);
+
+    if (!xc_core_endpoint_mode (local_endpoint, X_SENDING_ENDPOINT)) {
+        return x_error (X_E_ENDPOINT_MODE_MISMATCH, 0, endpoint);
+    }
+    if (total > X_ENDPOINT_SIZE_MASK) {
+        total = X_ENDPOINT_SYNC_CONTROL;   // flagged as an error after synchronising
+    }
+    return xs_send (local_endpoint, layout->base, total, NULL, 0, layout);
+}
+
+int x_sync_receive_strided (x_endpoint_handle_t endpoint, const x_stride_t * layout)
+{
+    x_endpoint_t *local_endpoint = (x_endpoint_t*) endpoint;
+    uint32_t      total = xs_layout_size (layout);
+
+    if (!xc_core_endpoint_mode (local_endpoint, X_RECEIVING_ENDPOINT)) {
+        return x_error (X_E_ENDPOINT_MODE_MISMATCH, 0, endpoint);
+    }
+    if (total > X_ENDPOINT_SIZE_MASK) {
+        return xs_receive (local_endpoint, 0, X_ENDPOINT_SYNC_CONTROL, 
+                           X_ENDPOINT_SYNC_CONTROL, NULL);
+    }
+    return xs_receive (local_endpoint, xtr_global_address (layout),
+                       X_ENDPOINT_STRIDED_CONTROL | total, total, NULL);
+}
+
+/* x_sync_send_large
+   x_sync_receive_large
+
+  Transfers of more than 64KB. Both peers flag the control word as a large
+  transfer, the low 29 bits holding the size. 
+
+  Algorithm:
+    Synchronise with the peer as for x_sync_send and x_sync_receive. The
+      sender insists on a large receiver, so that the two peers make the
+      same decision as to whether the transfer is done. 
+    The sender copies the data a chunk at a time, posting the number of
+      bytes copied so far to the receiver's transferred_from_peer after
+      each chunk, and completes the transfer as x_sync_send does. 
+    The receiver waits for transferred_from_peer to change, handing each
+      newly arrived piece to the chunk handler, until the completion 
+      sequence number arrives. 
+
+  Notes:
+    * The receiver clears its transferred_from_peer before posting its 
+      offer, which is safe since the sender cannot write to it until the
+      offer has been seen. Otherwise the size from the previous transfer
+      would look like progress. 
+    * The completion sequence number is read before the transferred size,
+      and the sender writes them in the opposite order, so once the 
+      completion has been seen the size is final. 
+    * The chunk handler may see pieces of any size - progress is only
+      seen when the receiver looks, and a plain sender reports the whole
+      transfer at once. 
+    * The sender wakes the receiver after each chunk, so the receiver 
+      waits through xc_wait_for_progress, spinning and then sleeping 
+      just as for a sequence number. 
+*/
+
+int x_sync_send_large (x_endpoint_handle_t endpoint, const void * buf, size_t size)
 {
     int                            result = -1;
     x_endpoint_t                  *local_endpoint  = (x_endpoint_t*) endpoint;
     x_endpoint_t                  *remote_endpoint = local_endpoint->remote_endpoint;
     register x_transfer_sequence_t new_sequence = (local_endpoint->sequence + 1);
-    x_transfer_control_t           size_from_peer;
+    x_transfer_control_t           control, size_from_peer;
+    x_transfer_control_t           transferred = X_ENDPOINT_SYNC_CONTROL;
+    size_t                         done, chunk;
+    char                          *dest;
 
-    if (local_endpoint->mode != X_RECEIVING_ENDPOINT) {
-        x_error (X_E_ENDPOINT_MODE_MISMATCH, 0, endpoint);
+    if (!xc_core_endpoint_mode (local_endpoint, X_SENDING_ENDPOINT)) {
+        return x_error (X_E_ENDPOINT_MODE_MISMATCH, 0, endpoint);
+    }
+    control = ((size == 0) || (size > X_ENDPOINT_LARGE_SIZE_MASK)) ?
+              X_ENDPOINT_SYNC_CONTROL : (X_ENDPOINT_LARGE_CONTROL | size);
+    remote_endpoint->address_from_peer  = xtr_global_address (buf);
+    remote_endpoint->control_from_peer  = control;
+    remote_endpoint->sequence_from_peer = new_sequence;
+    xc_ring_doorbell (local_endpoint);
+
+    xc_wait_for_sequence (local_endpoint, &local_endpoint->sequence_from_peer, new_sequence);
+    size_from_peer = local_endpoint->control_from_peer;
+    local_endpoint->sequence = new_sequence;
+    if (control == X_ENDPOINT_SYNC_CONTROL) {
+        x_error (X_E_INVALID_TRANSFER_SIZE, size, endpoint);
+    }
+    else if (!(size_from_peer & X_ENDPOINT_LARGE_CONTROL)) {
+        x_error (X_E_SYNC_TRANSFER_MISMATCH, size_from_peer, endpoint);
+    }        
+    else if ((size_from_peer & X_ENDPOINT_LARGE_SIZE_MASK) < size) {
+        x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, 
+                 size_from_peer & X_ENDPOINT_LARGE_SIZE_MASK, endpoint);
     }
     else {
-        if ((((x_transfer_address_t)buf) >> 20) == 0) {
-            remote_endpoint->address_from_peer = 
-                ((x_transfer_address_t)buf) | x_global_address_local_coreid_bits; 
-        }
-        else {
-            remote_endpoint->address_from_peer = (x_transfer_address_t)buf;
-        }
-        remote_endpoint->control_from_peer  = size;
-        remote_endpoint->sequence_from_peer = new_sequence;
-
-        while (local_endpoint->sequence_from_peer != new_sequence) { } ;
-        size_from_peer = local_endpoint->control_from_peer;
-        local_endpoint->sequence = new_sequence;
-        if (size == X_ENDPOINT_SYNC_CONTROL) {
-            x_error (X_E_INVALID_TRANSFER_SIZE, size, endpoint);
+        dest = (char*)local_endpoint->address_from_peer;
+        for (done = 0; done < size; done += chunk) {
+            chunk = size - done;
+            if (chunk > X_LARGE_TRANSFER_CHUNK_SIZE) {
+                chunk = X_LARGE_TRANSFER_CHUNK_SIZE;
+            }
+            xtr_transfer (dest + done, (const char*)buf + done, chunk);
+            remote_endpoint->transferred_from_peer = done + chunk;
+            xc_wake_peer (local_endpoint);
         }
-        else if (size_from_peer == X_ENDPOINT_SYNC_CONTROL) {
-            x_error (X_E_SYNC_TRANSFER_MISMATCH, size_from_peer, endpoint);
-        }        
-        else if (size_from_peer > size) {
-            x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, size_from_peer, endpoint);
+        transferred = size;
+        result      = size;
+    }
+    remote_endpoint->transferred_from_peer = transferred;
+    remote_endpoint->completed_from_peer   = new_sequence;
+    xc_wake_peer (local_endpoint);
+    return result;
+}
+
+int x_sync_receive_large (x_endpoint_handle_t endpoint, void * buf, size_t size,
+                          x_chunk_handler_t handler, void * context)
+{
+    int                            result = -1;
+    x_endpoint_t                  *local_endpoint  = (x_endpoint_t*) endpoint;
+    x_endpoint_t                  *remote_endpoint = local_endpoint->remote_endpoint;
+    register x_transfer_sequence_t new_sequence = (local_endpoint->sequence + 1);
+    x_transfer_control_t           control, size_from_peer;
+    x_bool_t                       peer_completed;
+    size_t                         consumed = 0, available;
+
+    if (!xc_core_endpoint_mode (local_endpoint, X_RECEIVING_ENDPOINT)) {
+        return x_error (X_E_ENDPOINT_MODE_MISMATCH, 0, endpoint);
+    }
+    control = ((size == 0) || (size > X_ENDPOINT_LARGE_SIZE_MASK)) ?
+              X_ENDPOINT_SYNC_CONTROL : (X_ENDPOINT_LARGE_CONTROL | size);
+    local_endpoint->transferred_from_peer = 0;
+    remote_endpoint->address_from_peer  = xtr_global_address (buf);
+    remote_endpoint->control_from_peer  = control;
+    remote_endpoint->sequence_from_peer = new_sequence;
+    xc_ring_doorbell (local_endpoint);
+
+    xc_wait_for_sequence (local_endpoint, &local_endpoint->sequence_from_peer, new_sequence);
+    size_from_peer = local_endpoint->control_from_peer & X_ENDPOINT_LARGE_SIZE_MASK;
+    peer_completed = (local_endpoint->completed_from_peer == new_sequence);
+    local_endpoint->sequence = new_sequence;
+    if (control == X_ENDPOINT_SYNC_CONTROL) {
+        x_error (X_E_INVALID_TRANSFER_SIZE, size, endpoint);
+    }
+    else if (!peer_completed && (size_from_peer == X_ENDPOINT_SYNC_CONTROL)) {
+        x_error (X_E_SYNC_TRANSFER_MISMATCH, size_from_peer, endpoint);
+    }        
+    else if (!peer_completed && (size_from_peer > size)) {
+        x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, size_from_peer, endpoint);
+    }
+    else {
+        for (;;) {
+            peer_completed = (local_endpoint->completed_from_peer == new_sequence);
+            available      = local_endpoint->transferred_from_peer;
+            if (peer_completed && (available == X_ENDPOINT_SYNC_CONTROL)) {
+                x_error (X_E_SYNC_TRANSFER_MISMATCH, available, endpoint);
+                break;
+            }
+            if (available > consumed) {
+                if (handler != NULL) {
+                    handler ((char*)buf + consumed, available - consumed, context);
+                }
+                consumed = available;
+            }
+            if (peer_completed) {
+                result = consumed;
+                break;
+            }
+            xc_wait_for_progress (local_endpoint, 
+                                  &local_endpoint->completed_from_peer, new_sequence,
+                                  &local_endpoint->transferred_from_peer, available);
         }
-        else {
-            new_sequence++;
-            remote_endpoint->sequence_from_peer = new_sequence;
-            while (local_endpoint->sequence_from_peer != new_sequence) { } ;
-            local_endpoint->sequence = new_sequence;
-            result = size_from_peer;
-        }    
+    }    
+    return result;
+}
+
+/* x_acquire_send_buffer
+   x_commit_send
+
+  Zero-copy sending: the sender is lent the receiver's buffer, builds the
+  message in place, and then commits it. Together these are equivalent
+  to x_sync_send without the copy. 
+
+  x_acquire_send_buffer waits for the receiver, exactly as the first 
+  part of x_sync_send, offering a transfer of the given (maximum) size.
+  It returns the global address of the receiver's buffer, or NULL if 
+  the receiver's buffer is too small or is not a plain buffer. 
+
+  x_commit_send tells the receiver that the message is complete, posting
+  the size actually written just as x_sync_send posts the size copied. 
+  It returns that size, or -1 if it is bigger than the size acquired. 
+
+  Notes:
+    * x_commit_send must be called exactly once after each successful 
+      x_acquire_send_buffer, and no other transfer may be done on the
+      endpoint in between. The receiver remains in x_sync_receive until
+      the commit. 
+    * When the acquire fails the peer has already been told, so there 
+      is nothing to commit. 
+    * The buffer is in the receiver's memory, so the sender should write
+      to it sequentially, and avoid reading from it - remote reads are
+      much slower than remote writes. 
+    * The receiver's buffer size is still in the sender's endpoint at the
+      time of the commit, because the receiver cannot post another offer
+      until the transfer is completed. 
+*/
+
+void * x_acquire_send_buffer (x_endpoint_handle_t endpoint, x_transfer_size_t size)
+{
+    x_endpoint_t                  *local_endpoint  = (x_endpoint_t*) endpoint;
+    x_endpoint_t                  *remote_endpoint = local_endpoint->remote_endpoint;
+    register x_transfer_sequence_t new_sequence = (local_endpoint->sequence + 1);
+    x_transfer_control_t           size_from_peer;
+
+    if (!xc_core_endpoint_mode (local_endpoint, X_SENDING_ENDPOINT)) {
+        x_error (X_E_ENDPOINT_MODE_MISMATCH, 0, endpoint);
+        return NULL;
+    }
+    remote_endpoint->address_from_peer  = 0;
+    remote_endpoint->control_from_peer  = size;
+    remote_endpoint->sequence_from_peer = new_sequence;
+    xc_ring_doorbell (local_endpoint);
+
+    xc_wait_for_sequence (local_endpoint, &local_endpoint->sequence_from_peer, new_sequence);
+    size_from_peer = local_endpoint->control_from_peer;
+    local_endpoint->sequence = new_sequence;
+    if (size == X_ENDPOINT_SYNC_CONTROL) {
+        x_error (X_E_INVALID_TRANSFER_SIZE, size, endpoint);
+    }
+    else if ((size_from_peer == X_ENDPOINT_SYNC_CONTROL) ||
+             (size_from_peer & X_ENDPOINT_CONTROL_FLAGS)) {
+        x_error (X_E_SYNC_TRANSFER_MISMATCH, size_from_peer, endpoint);
+    }        
+    else if (size_from_peer < size) {
+        x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, size_from_peer, endpoint);
+    }
+    else {
+        return (void*)local_endpoint->address_from_peer;
+    }
+    remote_endpoint->transferred_from_peer = X_ENDPOINT_SYNC_CONTROL;
+    remote_endpoint->completed_from_peer   = new_sequence;
+    xc_wake_peer (local_endpoint);
+    return NULL;
+}
+
+int x_commit_send (x_endpoint_handle_t endpoint, x_transfer_size_t size)
+{
+    x_endpoint_t         *local_endpoint  = (x_endpoint_t*) endpoint;
+    x_endpoint_t         *remote_endpoint = local_endpoint->remote_endpoint;
+    x_transfer_control_t  transferred = size;
+    int                   result = size;
+
+    if (!xc_core_endpoint_mode (local_endpoint, X_SENDING_ENDPOINT)) {
+        return x_error (X_E_ENDPOINT_MODE_MISMATCH, 0, endpoint);
     }
+    if ((size == X_ENDPOINT_SYNC_CONTROL) || 
+        (size > local_endpoint->control_from_peer)) {
+        x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, size, endpoint);
+        transferred = X_ENDPOINT_SYNC_CONTROL;
+        result      = -1;
+    }
+    remote_endpoint->transferred_from_peer = transferred;
+    remote_endpoint->completed_from_peer   = local_endpoint->sequence;
+    xc_wake_peer (local_endpoint);
     return result;
 }
 
+/* x_try_send
+   x_try_receive
+
+  Non-blocking transfers, built on x_endpoint_ready. 
+
+  If the peer's offer has already arrived the blocking call will not wait
+  for it - the receiver may still wait briefly while the sender copies
+  the data, but the sender is known to be committed to the transfer. 
+  Otherwise nothing is written to the peer, so there is nothing to undo. 
+
+  Notes:
+    * X_WOULD_BLOCK is negative but distinct from the -1 error return. 
+    * For a buffered sender the test is whether the ring has room for 
+      this particular message, rather than for any message at all. 
+*/
+
+int x_try_send (x_endpoint_handle_t endpoint, const void * buf, 
+                x_transfer_size_t size)
+{
+    x_endpoint_t *local_endpoint = (x_endpoint_t*) endpoint;
+
+    if ((local_endpoint->mode == X_BUFFERED_SENDING_ENDPOINT) ?
+        !xb_room_for (local_endpoint, size) : !x_endpoint_ready (endpoint)) {
+        return X_WOULD_BLOCK;
+    }
+    return x_sync_send (endpoint, buf, size);
+}
+
+int x_try_receive (x_endpoint_handle_t endpoint, void * buf, 
+                   x_transfer_size_t size)
+{
+    if (!x_endpoint_ready (endpoint)) {
+        return X_WOULD_BLOCK;
+    }
+    return x_sync_receive (endpoint, buf, size);
+}
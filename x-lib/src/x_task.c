@@ -33,6 +33,10 @@ see the files COPYING and COPYING.LESSER. If not, see
 #ifdef __epiphany__
 #include <e_lib.h>
 #include <e_coreid.h>
+#else
+#include <stdlib.h>
+#include <unistd.h>
+#include <x_epiphany_control.h>
 #endif
 
 #include <x_error.h>
@@ -42,6 +46,9 @@ see the files COPYING and COPYING.LESSER. If not, see
 #include <x_task.h>
 #include <x_application_internals.h>
 #include <x_endpoint.h>
+#include <x_sync.h>
+#include <x_buffered_internals.h>
+#include <x_host_ring_internals.h>
 
 /* x_global_address_local_coreid_bits
 
@@ -53,6 +60,24 @@ see the files COPYING and COPYING.LESSER. If not, see
 
 x_transfer_address_t x_global_address_local_coreid_bits = 0;
 
+/* x_endpoint_doorbell
+
+   Written by peers whenever they post something to one of this task's
+   endpoints, so that x_wait_any can wait on a single word rather than
+   polling every endpoint. The value written has no meaning. 
+*/
+
+volatile uint32_t  x_endpoint_doorbell = 0;
+volatile uint32_t *x_task_doorbell     = &x_endpoint_doorbell;
+
+/* x_barrier_flags
+
+   Written by the peers in each round of x_barrier (see x_collective.c).
+   The global address is published in the task descriptor at startup. 
+*/
+
+volatile uint32_t x_barrier_flags[X_BARRIER_MAX_ROUNDS];
+
 #define DO_TASK_HEARTBEAT { x_task_control.descriptor->heartbeat = ++x_task_control.heartbeat; }
 
 static x_task_control_t x_task_control;
@@ -72,6 +97,19 @@ x_task_id_t x_get_task_id ()
         return x_task_control.task_id;
 }
 
+/* xt_set_task_state
+
+   See x_application_internals.h
+*/
+
+x_task_state_t xt_set_task_state (x_task_state_t state)
+{
+        x_task_state_t previous_state = x_task_control.descriptor->state;
+
+        x_task_control.descriptor->state = state;
+        return previous_state;
+}
+
 /* x_get_task_environment
 
   The size of the workgroup must be obtained from the global x_application_data
@@ -111,57 +149,117 @@ void x_set_task_status (const char *format, ...)
 
 /* x_get_endpoint
 
-  Since keys are unique per task, simply look through the endpoint list
-  to find the endpoint that matches the supplied key. 
+  Looks up the endpoint that matches the supplied key (keys are unique 
+  per task) in the on-core key index built by xt_initialise_endpoints, 
+  so that nothing is read from external RAM.
 
   x_error is called and NULL returned if there is no local endpoint
   associated with the key - though this is not likely to be an error that 
   the caller can deal with gracefully.
 
-  The search for matching key is necessarily in external RAM. If this turns
-  out to be a source of performance issues, the key can be copied into the
-  local endpoint structures. 
+  Algorithm:
+    If the key is one of the mesh keys, whose low 28 bits are zero
+      Return the entry for it in the direct index, if there is one
+    Binary search of the key index
 */
 
 x_endpoint_handle_t x_get_endpoint (int key)
 {
-  x_endpoint_handle_t result = NULL;
-  x_endpoint_t *endpoint,
-               *last_endpoint = x_task_control.endpoints + x_task_control.num_endpoints - 1;
-
-  x_connection_t *connection_list = (x_connection_t*) (((char*)x_application) +
-                                                        x_application->connection_list_offset);
-
-  if (connection_list && x_task_control.endpoints) {
-
-    for (endpoint = x_task_control.endpoints; endpoint <= last_endpoint; endpoint++) {
-      if (endpoint->mode == X_SENDING_ENDPOINT &&
-          connection_list[endpoint->connection_id].source_key == key) {
-        return (x_endpoint_handle_t)endpoint;
-      }
-      else if (endpoint->mode == X_RECEIVING_ENDPOINT &&
-               connection_list[endpoint->connection_id].sink_key == key) {
-        return (x_endpoint_handle_t)endpoint;
-      }
+  uint32_t mesh_key = ((uint32_t)key) >> 28;
+  int      low = 0, high = x_task_control.num_keys - 1, middle;
+
+  if ((((uint32_t)key & 0x0FFFFFFF) == 0) && (mesh_key >= 1) && 
+      (mesh_key <= X_MESH_KEYS) && 
+      (x_task_control.mesh_endpoints[mesh_key - 1] != NULL)) {
+    return (x_endpoint_handle_t)x_task_control.mesh_endpoints[mesh_key - 1];
+  }
+  while (low <= high) {
+    middle = (low + high) / 2;
+    if (x_task_control.key_index[middle].key == key) {
+      return (x_endpoint_handle_t)x_task_control.key_index[middle].endpoint;
+    }
+    else if (x_task_control.key_index[middle].key < key) {
+      low = middle + 1;
+    }
+    else {
+      high = middle - 1;
     }
-  }   
+  }
   x_error (X_E_GET_ENDPOINT_KEY_NOT_FOUND, key, NULL);
-  return result;
+  return NULL;
 }   
 
+/* xt_index_endpoint
+
+  Adds an endpoint to the key index, keeping it sorted - an insertion 
+  sort, as there are few endpoints and this is only done at startup. 
+  Mesh keys also go in the direct index. 
+*/
+
+static void xt_index_endpoint (int key, x_endpoint_t * endpoint)
+{
+  uint32_t mesh_key = ((uint32_t)key) >> 28;
+  int      i;
+
+  for (i = x_task_control.num_keys; 
+       (i > 0) && (x_task_control.key_index[i-1].key > key); i--) {
+    x_task_control.key_index[i] = x_task_control.key_index[i-1];
+  }
+  x_task_control.key_index[i].key      = key;
+  x_task_control.key_index[i].endpoint = endpoint;
+  x_task_control.num_keys++;
+  if ((((uint32_t)key & 0x0FFFFFFF) == 0) && (mesh_key >= 1) && 
+      (mesh_key <= X_MESH_KEYS)) {
+    x_task_control.mesh_endpoints[mesh_key - 1] = endpoint;
+  }
+}
+
+/* xt_attach_host_task
+
+   A host task is a process of its own, started by x_launch_task, so it 
+   must map the Epiphany resources for itself to reach the application
+   data in shared DRAM. The system is not reset, since the cores may 
+   already be running. It also opens the host shared memory segment, 
+   which holds the application data when there is no Epiphany device - 
+   see x_host_ring.c. 
+*/
+
+#ifndef __epiphany__
+static x_return_stat_t xt_attach_host_task ()
+{
+        if ((getenv (X_TASK_ID_ENVIRONMENT_VARIABLE) == NULL) ||
+            (NULL == (x_host_shared_memory = xhr_attach_shared_memory ()))) {
+          return x_error (X_E_HOST_TASK_ATTACH_FAILED, 0, NULL);
+        }
+        if (E_OK != e_init (NULL)) {
+          x_application = (x_application_t*)x_host_shared_memory;
+        }
+        else if ((NULL == (x_epiphany_control = 
+                             x_map_epiphany_resources (NULL, 0, 0, 0, 0))) ||
+                 (NULL == (x_application = (x_application_t*)
+                             x_epiphany_to_host_address (x_epiphany_control, 0, 0,
+                                                         X_EPIPHANY_SHARED_DRAM_BASE + 
+                                                             X_LIB_SECTION_OFFSET)))) {
+          return x_error (X_E_HOST_TASK_ATTACH_FAILED, 0, NULL);
+        }
+        return X_SUCCESS;
+}
+#endif
+
 /* x_initialise_task_control
 
    Initialise the local x_task_control structure, linking it back to the
    task descriptor in the xlib application data.
 
    The internal logic of this routine is different for Epiphany and
-   host tasks. 
+   host tasks. A host task cannot rely on finding its PID in the 
+   descriptor table, as it may start running before x_launch_task has
+   recorded it there, so the task ID is passed in the environment. 
 */
 
 static void xt_initialise_task_control ()
 {
         x_task_descriptor_t *task_descriptor_table;
-        int                  pid, workgroup_task_slots, i;
 
         task_descriptor_table = (x_task_descriptor_t*)
                 (((char*)x_application) + x_application->task_descriptor_table_offset);
@@ -174,17 +272,8 @@ static void xt_initialise_task_control ()
         x_task_control.task_id = (x_task_id_t)
                 (row * x_application->workgroup_columns) + col;        
 #else  // i.e. NOT __epiphany__
-        pid = getpid();
-        workgroup_task_slots = x_application->workgroup_rows *
-                               x_application->workgroup_columns;
-        for (i = workgroup_task_slots; 
-             i < workgroup_task_slots + x_application->host_task_slots; 
-             i++) {
-          if (task_descriptor_table[i].coreid_or_pid == pid) {
-            x_task_control.task_id = (x_task_id_t)i;
-            break;
-          }
-        }
+        x_task_control.task_id = (x_task_id_t)
+                atoi (getenv (X_TASK_ID_ENVIRONMENT_VARIABLE));
 #endif // __epiphany__
         x_task_control.descriptor = task_descriptor_table + 
                                     ((int)x_task_control.task_id);
@@ -193,6 +282,57 @@ static void xt_initialise_task_control ()
         x_task_control.endpoints     = NULL;
 }
 
+/* xt_host_endpoint_area
+   xt_host_staging_buffer
+
+   The endpoints and staging buffers of a host task are in shared DRAM,
+   see x_application_internals.h. 
+*/
+
+#ifndef __epiphany__
+static char * xt_host_endpoint_area ()
+{
+        return (char*)x_application + x_task_control.descriptor->host_endpoints;
+}
+
+void * xt_host_staging_buffer (x_endpoint_t * endpoint)
+{
+        return xt_host_endpoint_area () + 
+               X_HOST_STAGING_OFFSET(x_task_control.num_endpoints) +
+               (endpoint - x_task_control.endpoints) * X_HOST_STAGING_SIZE;
+}
+#endif
+
+/* xt_ring_storage_needed
+
+   Returns the number of bytes needed for the ring buffers of the buffered
+   connections on which this task is the receiver. 
+*/
+
+static size_t xt_ring_storage_needed ()
+{
+        size_t          result = 0;
+        x_task_id_t     this_task = x_get_task_id();
+        uint32_t       *connection_index;
+        x_connection_t *master_connection_list;
+        x_connection_t *connection;
+        int             i;
+
+        connection_index       = (uint32_t*)
+                                 ((char*)x_application + 
+                                  x_task_control.descriptor->connection_index);
+        master_connection_list = (x_connection_t*)
+                                 ((char*)x_application +
+                                  x_application->connection_list_offset);
+        for (i = 0; i < x_task_control.descriptor->num_connections; i++) {
+          connection = master_connection_list + connection_index[i];
+          if (connection->sink_task == this_task) {
+            result += XB_RING_BYTES(connection->buffer_size);
+          }
+        }
+        return result;
+}
+
 /* xt_initialise_endpoints
 
    Builds the list of endpoints basic on the task-specific indexes into
@@ -200,16 +340,25 @@ static void xt_initialise_task_control ()
    addresses of the endpoints, and also waiting for the communication
    peers to supply the addresses of their endpoints. 
 
-   On exit the endpoint list is full initialised. 
+   On exit the endpoint list is full initialised. Until the peer's 
+   endpoint is known, the peer's doorbell is taken to be our own so that
+   ringing it is harmless. 
 
    The endpoint list is received as parameter because in the Epiphany
    environment there is no on-core memory manager - the simplest way to
-   allocate memory areas of dynamic size is on the stack. 
+   allocate memory areas of dynamic size is on the stack. For the same 
+   reason the ring buffers of buffered connections are carved out of a
+   doubleword-aligned area supplied by the caller, of at least the size
+   given by xt_ring_storage_needed. The key index (see x_get_endpoint) 
+   is likewise supplied by the caller, with room for an entry per 
+   endpoint. 
 
 */
 
 x_return_stat_t xt_initialise_endpoints (x_endpoint_t * endpoint_array, 
-                                         size_t sizeof_endpoint_array)
+                                         size_t sizeof_endpoint_array,
+                                         uint64_t * ring_storage,
+                                         x_key_index_entry_t * key_index)
 {
         x_return_stat_t result = X_ERROR;
         x_task_id_t     this_task = x_get_task_id();
@@ -218,6 +367,8 @@ x_return_stat_t xt_initialise_endpoints (x_endpoint_t * endpoint_array,
         x_connection_t *master_connection_list;
         x_connection_t *connection;
         x_endpoint_t   *endpoint, *endpoint_global_address;
+        volatile uint32_t *doorbell_global_address;
+        char           *next_ring = (char*)ring_storage;
         int             i;
 
         num_endpoints          = x_task_control.descriptor->num_connections;
@@ -234,6 +385,8 @@ x_return_stat_t xt_initialise_endpoints (x_endpoint_t * endpoint_array,
         else {
           x_task_control.num_endpoints = num_endpoints;
           x_task_control.endpoints     = endpoint_array;
+          x_task_control.num_keys      = 0;
+          x_task_control.key_index     = key_index;
                 
           endpoint = &(x_task_control.endpoints[0]);
 #ifdef __epiphany__                
@@ -243,29 +396,74 @@ x_return_stat_t xt_initialise_endpoints (x_endpoint_t * endpoint_array,
           e_coords_from_coreid (coreid, &row, &col);
           endpoint_global_address = (x_endpoint_t*)
                                     e_get_global_address (row, col, endpoint);
+          doorbell_global_address = (volatile uint32_t*)
+                                    e_get_global_address (row, col, 
+                                        (void*)&x_endpoint_doorbell);
 #else
           endpoint_global_address = 
             (x_endpoint_t*)x_host_to_epiphany_shared_memory_address (endpoint);
+          doorbell_global_address = (volatile uint32_t*)
+            x_host_to_epiphany_shared_memory_address ((void*)x_task_doorbell);
 #endif                
           for (i = 0; i < num_endpoints; i++) {
             connection = master_connection_list + connection_index[i];
             endpoint->sequence_from_peer = 0;
             endpoint->control_from_peer  = 0;
 	    endpoint->address_from_peer  = 0;
+            endpoint->completed_from_peer   = 0;
+            endpoint->transferred_from_peer = 0;
+            endpoint->idle_from_peer        = 0;
 	    endpoint->sequence = 0;
             endpoint->connection_id   = connection_index[i];
+            endpoint->num_receivers   = ((connection->multicast > 0) &&
+                                         (connection->source_task == this_task)) ?
+                                        connection->multicast : 1;
             endpoint->remote_endpoint = NULL;                  
+            endpoint->doorbell        = doorbell_global_address;
+            endpoint->peer_doorbell   = x_task_doorbell;
+#ifndef __epiphany__
+            if (connection->host_ring != 0) {
+              xhr_initialise_endpoint (endpoint, connection->host_ring,
+                                       connection->source_task == this_task);
+              if (connection->source_task == this_task) {
+                connection->source_endpoint = endpoint_global_address;
+              }
+              else {
+                connection->sink_endpoint   = endpoint_global_address;
+              }
+            }
+            else
+#endif
             if (connection->source_task == this_task) {
-              endpoint->mode              = X_SENDING_ENDPOINT;
+              endpoint->mode              = (connection->multicast > 0) ?
+                                              X_MULTICAST_SENDING_ENDPOINT :
+                                            (connection->multicast < 0) ?
+                                              X_MULTICAST_MEMBER_ENDPOINT :
+                                            (connection->buffer_size == 0) ?
+                                              X_SENDING_ENDPOINT :
+                                              X_BUFFERED_SENDING_ENDPOINT;
               connection->source_endpoint = endpoint_global_address;
             }
             else if (connection->sink_task == this_task) {
-              endpoint->mode              = X_RECEIVING_ENDPOINT;
+              if (connection->buffer_size == 0) {
+                endpoint->mode = X_RECEIVING_ENDPOINT;
+              }
+              else {
+                xb_initialise_receiver (endpoint, next_ring, 
+                                        XB_RING_BYTES(connection->buffer_size));
+                next_ring += XB_RING_BYTES(connection->buffer_size);
+              }
               connection->sink_endpoint   = endpoint_global_address;
             }
             else { 
               endpoint->mode = X_UNINITIALISED_ENDPOINT;
             }        
+            if ((endpoint->mode != X_UNINITIALISED_ENDPOINT) &&
+                (endpoint->mode != X_MULTICAST_MEMBER_ENDPOINT)) {
+              xt_index_endpoint ((connection->source_task == this_task) ?
+                                   connection->source_key : connection->sink_key,
+                                 endpoint);
+            }
             endpoint++;
             endpoint_global_address++;
           }
@@ -280,7 +478,11 @@ x_return_stat_t xt_initialise_endpoints (x_endpoint_t * endpoint_array,
               if ((endpoint->mode != X_UNINITIALISED_ENDPOINT) &&
                   (endpoint->remote_endpoint == NULL)) {
                 connection = master_connection_list + connection_index[i];
-                if ((endpoint->mode == X_SENDING_ENDPOINT) &&
+                if (((endpoint->mode == X_SENDING_ENDPOINT) ||
+                     (endpoint->mode == X_BUFFERED_SENDING_ENDPOINT) ||
+                     (endpoint->mode == X_MULTICAST_SENDING_ENDPOINT) ||
+                     (endpoint->mode == X_MULTICAST_MEMBER_ENDPOINT) ||
+                     (endpoint->mode == X_HOST_RING_SENDING_ENDPOINT)) &&
                     (connection->sink_endpoint != NULL)) {
                   endpoint->remote_endpoint = connection->sink_endpoint;
 #ifndef __epiphany__
@@ -289,7 +491,9 @@ x_return_stat_t xt_initialise_endpoints (x_endpoint_t * endpoint_array,
                             (endpoint->remote_endpoint);
 #endif                            
                 }
-                else if ((endpoint->mode == X_RECEIVING_ENDPOINT) &&
+                else if (((endpoint->mode == X_RECEIVING_ENDPOINT) ||
+                          (endpoint->mode == X_BUFFERED_RECEIVING_ENDPOINT) ||
+                          (endpoint->mode == X_HOST_RING_RECEIVING_ENDPOINT)) &&
                          (connection->source_endpoint != NULL)) {
                   endpoint->remote_endpoint = connection->source_endpoint;
 #ifndef __epiphany__
@@ -297,10 +501,21 @@ x_return_stat_t xt_initialise_endpoints (x_endpoint_t * endpoint_array,
                     (x_endpoint_t*) x_epiphany_core_memory_to_host_mapped_address
                             (endpoint->remote_endpoint);
 #endif                            
+                  if (endpoint->mode == X_BUFFERED_RECEIVING_ENDPOINT) {
+                    xb_post_ring (endpoint);
+                  }
                 }
                 else {
                   num_unresolved_endpoints++;
                 }
+                if (endpoint->remote_endpoint != NULL) {
+                  endpoint->peer_doorbell = endpoint->remote_endpoint->doorbell;
+#ifndef __epiphany__
+                  endpoint->peer_doorbell = (volatile uint32_t*)
+                    x_epiphany_core_memory_to_host_mapped_address
+                            ((void*)endpoint->peer_doorbell);
+#endif                            
+                }
               } 
               endpoint++;              
             }  
@@ -313,14 +528,18 @@ x_return_stat_t xt_initialise_endpoints (x_endpoint_t * endpoint_array,
         return result;	
 }
 
-/* main() for Epiphany tasks
+/* main() for Epiphany and host tasks
 
    The result must be a terminal task state - zero or negative. 
    Non-terminal result values and values outside the uint16_t range are
    mapped to the value X_E_TASK_RESULT_OUT_OF_RANGE;
+
+   The endpoints of a host task are in shared DRAM rather than on the 
+   stack, so that the cores can reach them. Its doorbell is the first 
+   word of the same area. 
 */
 
-int main ()
+int main (int argc, char *argv[])
 {
         int      task_result;
         uint16_t result_to_report;
@@ -330,20 +549,57 @@ int main ()
 	    ((x_transfer_address_t)e_get_coreid()) << 20;
 #else
 	x_global_address_local_coreid_bits = 0;
+        if (X_SUCCESS != xt_attach_host_task ()) {
+          fprintf (stderr, "%s: not started by x_launch_task, or the Epiphany resources could not be mapped\n",
+                   argv[0]);
+          return X_E_HOST_TASK_ATTACH_FAILED;
+        }
 #endif
 	
         xt_initialise_task_control();
+#ifdef __epiphany__
+        x_task_control.descriptor->barrier_flags = 
+            ((x_transfer_address_t)x_barrier_flags) | 
+            x_global_address_local_coreid_bits;
+#else
+        if (x_task_control.descriptor->host_endpoints != 0) {
+          x_task_doorbell = (volatile uint32_t*)xt_host_endpoint_area ();
+        }
+#endif
+        if (X_MESSAGING_CALIBRATE_DMA) {
+          x_calibrate_dma_thresholds ();
+        }
+#ifdef __epiphany__
+        if (X_MESSAGING_WAIT_SPIN_BUDGET) {
+          x_set_wait_spin_budget (X_MESSAGING_WAIT_SPIN_BUDGET);
+        }
+#endif
         
-        { // Allocate storage for endpoints on stack before proceeding
-          x_endpoint_t endpoints[x_task_control.descriptor->num_connections];
+        { // Allocate storage for endpoints and ring buffers on stack before proceeding
+          int           num_endpoints = x_task_control.descriptor->num_connections;
+#ifdef __epiphany__
+          x_endpoint_t  endpoint_storage[num_endpoints];
+          x_endpoint_t *endpoints = endpoint_storage;
+#else
+          x_endpoint_t *endpoints = (x_endpoint_t*)
+                                    (xt_host_endpoint_area () + X_HOST_ENDPOINTS_OFFSET);
+#endif
+          uint64_t      ring_storage[xt_ring_storage_needed()/sizeof(uint64_t) + 1];
+          x_key_index_entry_t key_index[num_endpoints];
 
           x_task_control.descriptor->state = X_INITIALIZING_TASK;
-          if (X_SUCCESS != xt_initialise_endpoints (endpoints, sizeof(endpoints))) {
+          if (X_SUCCESS != xt_initialise_endpoints (endpoints, 
+                                                    num_endpoints*sizeof(x_endpoint_t),
+                                                    ring_storage, key_index)) {
             result_to_report = x_last_error(NULL,NULL);	  
           }
           else {		
             x_task_control.descriptor->state = X_ACTIVE_TASK;
+#ifdef __epiphany__
             task_result = task_main (0, NULL);
+#else
+            task_result = task_main (argc, (const char**)argv);
+#endif
             if ( task_result > 0 || task_result <= X_E_ERROR_CODES_START ) { 
               result_to_report = X_E_TASK_RESULT_OUT_OF_RANGE;
             }
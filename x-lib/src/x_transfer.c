@@ -0,0 +1,781 @@
+/*
+File: x_transfer.c
+
+Copyright 2013 Mark Honman
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License (LGPL)
+as published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+and the GNU Lesser General Public License along with this program,
+see the files COPYING and COPYING.LESSER. If not, see
+<http://www.gnu.org/licenses/>.
+*/
+
+/* Data transfer functions that are too big to be inlined - the 
+   misaligned copy, the vector and strided transfers, and the functions 
+   that drive the DMA engine of the Epiphany core and decide when it is
+   worth using. 
+   See x_transfer_internals.h for the prototypes and the inline
+   building blocks.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include "x_lib_configuration.h"
+#include "x_types.h"
+#include "x_error.h"
+#include "x_sync.h"
+#include "x_connection_internals.h"
+#include "x_transfer_internals.h"
+#include "x_address.h"
+
+/* xtr_dma_threshold
+
+   Minimum transfer size in bytes for which x_sync_send uses the DMA
+   engine, indexed by alignment class. xtr_dma_threshold_min is the 
+   smallest of these, so that small transfers can skip the alignment
+   classification with a single test. 
+*/
+
+size_t xtr_dma_threshold[X_DMA_ALIGNMENT_CLASSES] = {
+    X_MESSAGING_MIN_DMA_BYTES_UNALIGNED,
+    X_MESSAGING_MIN_DMA_BYTES_WORD,
+    X_MESSAGING_MIN_DMA_BYTES_DOUBLEWORD
+};
+
+size_t xtr_dma_threshold_min = X_MESSAGING_MIN_DMA_BYTES_UNALIGNED;
+
+/* x_set_dma_thresholds
+
+   A threshold of zero leaves the corresponding value unchanged. 
+*/
+
+void x_set_dma_thresholds (size_t unaligned, size_t word_aligned, 
+                           size_t doubleword_aligned)
+{
+    int alignment_class;
+
+    if (unaligned != 0) {
+        xtr_dma_threshold[X_DMA_UNALIGNED] = unaligned;
+    }
+    if (word_aligned != 0) {
+        xtr_dma_threshold[X_DMA_WORD_ALIGNED] = word_aligned;
+    }
+    if (doubleword_aligned != 0) {
+        xtr_dma_threshold[X_DMA_DOUBLEWORD_ALIGNED] = doubleword_aligned;
+    }
+    xtr_dma_threshold_min = xtr_dma_threshold[0];
+    for (alignment_class = 1; alignment_class < X_DMA_ALIGNMENT_CLASSES; alignment_class++) {
+        if (xtr_dma_threshold[alignment_class] < xtr_dma_threshold_min) {
+            xtr_dma_threshold_min = xtr_dma_threshold[alignment_class];
+        }
+    }
+}
+
+/* xtr_copy_misaligned
+
+  Copies between buffers that are not both word-aligned, see xtr_copy. 
+
+  Algorithm:
+    Copy bytes until the destination is word-aligned
+    If the source is now word-aligned too, the rest is an aligned copy
+    Otherwise, with the source offset by 1 to 3 bytes from a word boundary
+      Load the aligned source word holding the next byte
+      If the destination is not doubleword-aligned
+        Store a word merged from this and the next source word
+      while size remaining >= 8
+        Load the next two aligned source words, and merge each with the
+        one before by shifting - giving two destination words that are
+        stored as a double word
+      if size remaining >= 4
+        Store a word merged as above
+      Copy the remaining bytes
+
+  Notes:
+    * The merge is for little-endian byte order (the Epiphany and the ARM
+      host): the first bytes of a destination word are the upper bytes 
+      of the earlier source word. 
+    * An aligned source word is only loaded when it holds at least one 
+      byte of the source, so nothing is read beyond the buffer. 
+    * The shift is never 0 or 32 bits. 
+*/
+
+void xtr_copy_misaligned (void * dest, const void * src, size_t size)
+{
+    const char     *src_ptr  = (const char*)src;
+    char           *dest_ptr = (char*)dest;
+    char           *after_end_ptr = dest_ptr + size;
+    const uint32_t *src_word;
+    uint32_t        previous, next, shift;
+    union { uint64_t doubleword; uint32_t word[2]; } value;
+
+    while (((uint32_t)dest_ptr & 0x3) && (dest_ptr < after_end_ptr)) {
+        *dest_ptr++ = *src_ptr++;
+    }
+    if (((uint32_t)src_ptr & 0x3) == 0) {
+        xtr_copy (dest_ptr, src_ptr, after_end_ptr - dest_ptr);
+        return;
+    }
+    if (after_end_ptr - dest_ptr >= 4) {
+        shift    = ((uint32_t)src_ptr & 0x3) * 8;
+        src_word = (const uint32_t*)(src_ptr - ((uint32_t)src_ptr & 0x3));
+        previous = *src_word++;
+        if ((uint32_t)dest_ptr & 0x4) {
+            next     = *src_word++;
+            *((uint32_t*)dest_ptr) = (previous >> shift) | (next << (32 - shift));
+            previous = next;
+            dest_ptr += 4;
+            src_ptr  += 4;
+        }
+        while (after_end_ptr - dest_ptr >= 8) {
+            next          = *src_word++;
+            value.word[0] = (previous >> shift) | (next << (32 - shift));
+            previous      = *src_word++;
+            value.word[1] = (next >> shift) | (previous << (32 - shift));
+            *((uint64_t*)dest_ptr) = value.doubleword;
+            dest_ptr += 8;
+            src_ptr  += 8;
+        }
+        if (after_end_ptr - dest_ptr >= 4) {
+            next = *src_word;
+            *((uint32_t*)dest_ptr) = (previous >> shift) | (next << (32 - shift));
+            dest_ptr += 4;
+            src_ptr  += 4;
+        }
+    }
+    while (dest_ptr < after_end_ptr) {
+        *dest_ptr++ = *src_ptr++;
+    }
+}
+
+/* xtr_vector_transfer
+
+  Copies data from a list of source segments to the receiver's buffer, 
+  which is either contiguous or a list of segments in the receiver's 
+  memory, as indicated by the control word posted by the receiver. 
+
+  Returns the size transferred, or -1 if the receiver's buffer is too 
+  small. 
+
+  Algorithm:
+    Walk the source and destination segment lists in step, copying with
+      xtr_transfer the largest piece that fits in both the current source 
+      segment and the current destination segment. 
+
+  Notes:
+    * Each destination segment descriptor is read from the receiver's 
+      memory just once, when it is reached. 
+    * Segment addresses in the receiver's list are local to the receiver,
+      and are made global using the coreid bits of the list's address. 
+    * Zero-length segments are skipped on both sides. 
+*/
+
+int xtr_vector_transfer (const x_iovec_t * source, int source_count,
+                         x_transfer_size_t size,
+                         x_transfer_address_t dest_address,
+                         x_transfer_control_t dest_control)
+{
+    const x_iovec_t     *dest_list   = NULL;
+    int                  dest_count  = 1;
+    int                  dest_index  = 1;
+    int                  source_index = 0;
+    char                *dest_ptr    = (char*)dest_address;
+    const char          *source_ptr  = NULL;
+    size_t               dest_left   = dest_control;
+    size_t               source_left = 0;
+    size_t               remaining   = size;
+    size_t               piece;
+    x_transfer_address_t segment_address;
+    x_transfer_address_t coreid_bits = dest_address & X_GLOBAL_ADDRESS_COREID_MASK;
+
+    if (dest_control & X_ENDPOINT_VECTOR_CONTROL) {
+        dest_list  = (const x_iovec_t*)dest_address;
+        dest_count = (dest_control >> X_ENDPOINT_SEGMENT_COUNT_SHIFT) & 
+                     X_ENDPOINT_MAX_SEGMENTS;
+        dest_index = 0;
+        dest_left  = 0;
+        if ((dest_control & X_ENDPOINT_SIZE_MASK) < size) {
+            return x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, 
+                            dest_control & X_ENDPOINT_SIZE_MASK, (void*)dest_list);
+        }
+    }
+    while (remaining > 0) {
+        while ((source_left == 0) && (source_index < source_count)) {
+            source_ptr  = (const char*)source[source_index].base;
+            source_left = source[source_index].size;
+            source_index++;
+        }
+        while ((dest_left == 0) && (dest_index < dest_count)) {
+            segment_address = (x_transfer_address_t)dest_list[dest_index].base;
+            if ((segment_address >> 20) == 0) {
+                segment_address |= coreid_bits;
+            }
+            dest_ptr  = (char*)segment_address;
+            dest_left = dest_list[dest_index].size;
+            dest_index++;
+        }
+        if ((source_left == 0) || (dest_left == 0)) {
+            return x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, 
+                            size - remaining, (void*)dest_list);
+        }
+        piece = (source_left < dest_left) ? source_left : dest_left;
+        if (piece > remaining) {
+            piece = remaining;
+        }
+        xtr_transfer (dest_ptr, source_ptr, piece);
+        dest_ptr    += piece;
+        dest_left   -= piece;
+        source_ptr  += piece;
+        source_left -= piece;
+        remaining   -= piece;
+    }
+    return size;
+}
+
+/* Strided transfers
+
+  A strided layout is walked as a sequence of contiguous runs: a whole
+  row when the elements of a row are adjacent, otherwise single elements.
+  xtr_cursor_t keeps track of the position in the layout. 
+*/
+
+typedef struct {
+    char     *row;
+    char     *run;
+    uint32_t  run_size;
+    int32_t   run_stride;
+    uint32_t  runs_per_row;
+    int32_t   row_stride;
+    uint32_t  runs_left_in_row;
+    uint32_t  rows_left;
+} xtr_cursor_t;
+
+static void xtr_cursor_init (xtr_cursor_t * cursor, const x_stride_t * layout,
+                             char * base)
+{
+    cursor->row = base;
+    cursor->run = base;
+    if (layout->inner_stride == layout->element_size) {
+        cursor->run_size     = layout->element_size * layout->inner_count;
+        cursor->run_stride   = 0;
+        cursor->runs_per_row = 1;
+    }
+    else {
+        cursor->run_size     = layout->element_size;
+        cursor->run_stride   = layout->inner_stride;
+        cursor->runs_per_row = layout->inner_count;
+    }
+    cursor->row_stride       = layout->outer_stride;
+    cursor->runs_left_in_row = cursor->runs_per_row;
+    cursor->rows_left        = layout->outer_count;
+}
+
+static x_bool_t xtr_cursor_next (xtr_cursor_t * cursor, char ** run, 
+                                 size_t * run_size)
+{
+    if (cursor->rows_left == 0) {
+        return X_FALSE;
+    }
+    *run      = cursor->run;
+    *run_size = cursor->run_size;
+    if (--cursor->runs_left_in_row == 0) {
+        cursor->rows_left--;
+        cursor->row             += cursor->row_stride;
+        cursor->run              = cursor->row;
+        cursor->runs_left_in_row = cursor->runs_per_row;
+    }
+    else {
+        cursor->run += cursor->run_stride;
+    }
+    return X_TRUE;
+}
+
+/* xtr_contiguous_layout
+
+  Describes a contiguous buffer with the same shape as the given layout,
+  so that the two can be matched up for a DMA transfer. 
+*/
+
+static void xtr_contiguous_layout (x_stride_t * contiguous, void * base,
+                                   const x_stride_t * shape)
+{
+    contiguous->base         = base;
+    contiguous->element_size = shape->element_size;
+    contiguous->inner_count  = shape->inner_count;
+    contiguous->inner_stride = shape->element_size;
+    contiguous->outer_count  = shape->outer_count;
+    contiguous->outer_stride = shape->element_size * shape->inner_count;
+}
+
+#ifdef __epiphany__
+
+/* xtr_dma_2d_possible
+
+  The DMA engine can do a strided transfer in one go if both layouts
+  have the same shape, everything is aligned to the element size, and
+  the strides fit the 16-bit stride registers. 
+*/
+
+static x_bool_t xtr_stride_fits (int32_t stride)
+{
+    return (stride >= -32768) && (stride <= 32767);
+}
+
+static x_bool_t xtr_dma_2d_possible (const x_stride_t * source, 
+                                     const x_stride_t * dest)
+{
+    uint32_t width = source->element_size;
+    uint32_t alignment = (uint32_t)source->base | (uint32_t)dest->base | 
+                         source->inner_stride | source->outer_stride | 
+                         dest->inner_stride   | dest->outer_stride;
+    int32_t  last = (int32_t)source->inner_count - 1;
+
+    return (width == dest->element_size) &&
+           ((width == 1) || (width == 2) || (width == 4) || (width == 8)) &&
+           ((alignment & (width - 1)) == 0) &&
+           (source->inner_count == dest->inner_count) &&
+           (source->outer_count == dest->outer_count) &&
+           xtr_stride_fits (source->inner_stride) &&
+           xtr_stride_fits (dest->inner_stride) &&
+           xtr_stride_fits (source->outer_stride - last*source->inner_stride) &&
+           xtr_stride_fits (dest->outer_stride   - last*dest->inner_stride);
+}
+
+#endif /* __epiphany__ */
+
+/* xtr_strided_copy
+
+  Copies between two layouts holding the same number of bytes. On the 
+  Epiphany, layouts of matching shape that are big enough (by the DMA 
+  threshold for the element size) are moved by a single 2D DMA transfer.
+  Otherwise the runs of the two layouts are walked in step, copying the 
+  largest piece that fits in both the current source and destination 
+  runs with xtr_transfer. 
+*/
+
+static void xtr_strided_copy (const x_stride_t * dest, const x_stride_t * source,
+                              size_t size)
+{
+    xtr_cursor_t dest_cursor, source_cursor;
+    char        *dest_ptr = NULL, *source_ptr = NULL;
+    size_t       dest_left = 0, source_left = 0, piece;
+#ifdef __epiphany__
+    int          channel;
+    int          alignment_class = (source->element_size == 8) ? X_DMA_DOUBLEWORD_ALIGNED :
+                                   (source->element_size == 4) ? X_DMA_WORD_ALIGNED :
+                                                                 X_DMA_UNALIGNED;
+
+    if ((size >= xtr_dma_threshold[alignment_class]) &&
+        xtr_dma_2d_possible (source, dest) &&
+        ((channel = xtr_dma_acquire ((void*)dest)) >= 0)) {
+        if (X_SUCCESS == xtr_dma_start_2d (channel, dest->base, source->base,
+                                           source->element_size,
+                                           source->inner_count, source->outer_count,
+                                           source->inner_stride, dest->inner_stride,
+                                           source->outer_stride, dest->outer_stride)) {
+            while (xtr_dma_busy (channel)) { } ;
+            xtr_dma_release (channel);
+            return;
+        }
+        xtr_dma_release (channel);
+    }
+#endif
+    xtr_cursor_init (&dest_cursor,   dest,   (char*)dest->base);
+    xtr_cursor_init (&source_cursor, source, (char*)source->base);
+    while (size > 0) {
+        if ((source_left == 0) && 
+            !xtr_cursor_next (&source_cursor, &source_ptr, &source_left)) {
+            break;
+        }
+        if ((dest_left == 0) && 
+            !xtr_cursor_next (&dest_cursor, &dest_ptr, &dest_left)) {
+            break;
+        }
+        piece = (source_left < dest_left) ? source_left : dest_left;
+        if (piece > size) {
+            piece = size;
+        }
+        xtr_transfer (dest_ptr, source_ptr, piece);
+        dest_ptr    += piece;
+        dest_left   -= piece;
+        source_ptr  += piece;
+        source_left -= piece;
+        size        -= piece;
+    }
+}
+
+/* xtr_strided_transfer
+
+  Copies from a strided source layout, or from a contiguous buffer if the
+  layout is NULL, to a receiver whose buffer is either contiguous or 
+  described by a strided layout in the receiver's memory. 
+
+  Returns the size transferred, or -1 if the receiver's buffer is too 
+  small or is a segment list. 
+
+  Notes: 
+    * The receiver's layout is copied from its memory with a single 
+      xtr_copy, and its base address made global using the coreid bits 
+      of the layout's address. 
+    * A contiguous side takes on the shape of the strided side, so that 
+      the DMA engine can be used when the strided side is suitable. 
+*/
+
+int xtr_strided_transfer (const x_stride_t * source_layout, const void * buf,
+                          x_transfer_size_t size,
+                          x_transfer_address_t dest_address,
+                          x_transfer_control_t dest_control)
+{
+    x_stride_t           source, dest;
+    x_transfer_address_t base;
+
+    if (dest_control & X_ENDPOINT_VECTOR_CONTROL) {
+        return x_error (X_E_SYNC_TRANSFER_MISMATCH, dest_control, (void*)buf);
+    }
+    if (dest_control & X_ENDPOINT_STRIDED_CONTROL) {
+        if ((dest_control & X_ENDPOINT_SIZE_MASK) < size) {
+            return x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, 
+                            dest_control & X_ENDPOINT_SIZE_MASK, (void*)buf);
+        }
+        xtr_copy (&dest, (const void*)dest_address, sizeof(dest));
+        base = (x_transfer_address_t)dest.base;
+        if ((base >> 20) == 0) {
+            dest.base = (void*)(base | (dest_address & X_GLOBAL_ADDRESS_COREID_MASK));
+        }
+        if (source_layout != NULL) {
+            source = *source_layout;
+        }
+        else {
+            xtr_contiguous_layout (&source, (void*)buf, &dest);
+        }
+    }
+    else {
+        source = *source_layout;
+        xtr_contiguous_layout (&dest, (void*)dest_address, &source);
+    }
+    xtr_strided_copy (&dest, &source, size);
+    return size;
+}
+
+/* xtr_special_transfer
+
+  Handles transfers in which either side is not a simple contiguous 
+  buffer, choosing between vector and strided transfers. A vector source
+  cannot be sent to a strided receiver, nor a strided source to a vector
+  receiver. A large receiver (x_sync_receive_large) has a contiguous 
+  buffer, and is treated as a plain one once its size has been checked. 
+  Returns the size transferred or -1. 
+*/
+
+int xtr_special_transfer (const void * buf, x_transfer_size_t size,
+                          const x_iovec_t * iov, int iovcnt,
+                          const x_stride_t * layout,
+                          x_transfer_address_t dest_address,
+                          x_transfer_control_t dest_control)
+{
+    x_iovec_t segment;
+
+    if (dest_control & X_ENDPOINT_LARGE_CONTROL) {
+        dest_control &= X_ENDPOINT_LARGE_SIZE_MASK;
+        if (dest_control < size) {
+            return x_error (X_E_SEND_TOO_BIG_FOR_RECEIVE_BUFFER, dest_control, (void*)buf);
+        }
+        if ((iov == NULL) && (layout == NULL)) {
+            xtr_transfer ((void*)dest_address, buf, size);
+            return size;
+        }
+    }
+    if ((layout != NULL) || (dest_control & X_ENDPOINT_STRIDED_CONTROL)) {
+        if (iov != NULL) {
+            return x_error (X_E_SYNC_TRANSFER_MISMATCH, dest_control, (void*)iov);
+        }
+        return xtr_strided_transfer (layout, buf, size, dest_address, dest_control);
+    }
+    if (iov == NULL) {
+        segment.base = (void*)buf;
+        segment.size = size;
+        iov          = &segment;
+        iovcnt       = 1;
+    }
+    return xtr_vector_transfer (iov, iovcnt, size, dest_address, dest_control);
+}
+
+/* xtr_pull
+
+  Fetches the data offered by a sender with the pull flag set (see 
+  x_connection_internals.h) and completes the transfer on its behalf,
+  exactly as the sender would at the end of x_sync_send. The caller has
+  checked that the data fit. 
+  On the Epiphany a large pull is done by the DMA engine reading from the
+  sender's staging buffer in DRAM. In a host task the staging buffer 
+  address must first be mapped into the host address space. 
+*/
+
+int xtr_pull (x_endpoint_t * local_endpoint, void * buf, x_transfer_size_t size,
+              x_transfer_sequence_t sequence)
+{
+    x_endpoint_t *remote_endpoint = local_endpoint->remote_endpoint;
+    void         *src = (void*)local_endpoint->address_from_peer;
+
+#ifndef __epiphany__
+    src = x_epiphany_to_host_shared_memory_address (src);
+#endif
+    xtr_transfer (buf, src, size);
+    remote_endpoint->transferred_from_peer = size;
+    remote_endpoint->completed_from_peer   = sequence;
+    return size;
+}
+
+#ifdef __epiphany__
+
+#include <e_lib.h>
+
+/* The DMA engine reads its descriptor when a transfer is started, and
+   for chained transfers when a link is followed, so descriptors are
+   kept in static storage rather than on the caller's stack. 
+
+   xtr_dma_owner records who is using each of the core's DMA channels,
+   NULL when the channel is free. This is per-core so that synchronous 
+   sends and any number of background exchanges can share the channels. 
+*/
+
+static e_dma_desc_t xtr_dma_descriptor[X_DMA_CHANNELS];
+
+static void * volatile xtr_dma_owner[X_DMA_CHANNELS] = { NULL, NULL };
+
+/* xtr_dma_acquire
+   xtr_dma_release
+
+  Claims a free DMA channel for the given owner, returning the channel
+  number or -1 if both channels are in use. 
+*/
+
+int xtr_dma_acquire (void * owner)
+{
+    int channel;
+
+    for (channel = 0; channel < X_DMA_CHANNELS; channel++) {
+        if (xtr_dma_owner[channel] == NULL) {
+            xtr_dma_owner[channel] = owner;
+            return channel;
+        }
+    }
+    return -1;
+}
+
+void xtr_dma_release (int channel)
+{
+    xtr_dma_owner[channel] = NULL;
+}
+
+/* xtr_dma_channel_of
+
+  Returns the channel owned by the given owner, or -1. 
+*/
+
+int xtr_dma_channel_of (void * owner)
+{
+    int channel;
+
+    for (channel = 0; channel < X_DMA_CHANNELS; channel++) {
+        if (xtr_dma_owner[channel] == owner) {
+            return channel;
+        }
+    }
+    return -1;
+}
+
+/* xtr_dma_start
+   xtr_dma_start_2d
+
+  Start a transfer on the given DMA channel, returning immediately. 
+
+  xtr_dma_start moves a contiguous block, using the widest data size 
+  permitted by the alignment of the source, the destination, and the 
+  transfer size. 
+
+  xtr_dma_start_2d moves outer_count rows of inner_count items of the 
+  given width, loading the strides into the channel's stride registers.
+  The strides are in bytes between the starts of successive items and 
+  successive rows, and must fit in 16 bits once converted to the DMA
+  engine's form (see below). 
+
+  The caller must own the channel (see xtr_dma_acquire), and counts must
+  not exceed 65535 (always true for x_transfer_size_t transfers).
+
+  Returns X_SUCCESS or X_ERROR. 
+
+  Note: the DMA engine adds the inner stride to the address after each 
+    item, except for the last item of a row, where the outer stride is 
+    added instead. The outer stride is therefore relative to the last 
+    item of the row rather than the first. 
+*/
+
+x_return_stat_t xtr_dma_start_2d (int channel, void * dest, const void * src,
+                                  unsigned width, 
+                                  unsigned inner_count, unsigned outer_count,
+                                  int src_inner_stride, int dest_inner_stride,
+                                  int src_outer_stride, int dest_outer_stride)
+{
+    unsigned config = E_DMA_ENABLE | E_DMA_MASTER;
+
+    switch (width) {
+        case 8:  config |= E_DMA_DWORD; break;
+        case 4:  config |= E_DMA_WORD;  break;
+        case 2:  config |= E_DMA_HWORD; break;
+        default: config |= E_DMA_BYTE;  break;
+    }
+    e_dma_set_desc ((e_dma_id_t)channel, config, NULL,
+                    src_inner_stride & 0xFFFF, dest_inner_stride & 0xFFFF,
+                    inner_count, outer_count,
+                    (src_outer_stride  - (int)(inner_count - 1)*src_inner_stride)  & 0xFFFF,
+                    (dest_outer_stride - (int)(inner_count - 1)*dest_inner_stride) & 0xFFFF,
+                    (void*)src, dest,
+                    xtr_dma_descriptor + channel);
+    return (0 == e_dma_start (xtr_dma_descriptor + channel, (e_dma_id_t)channel)) 
+             ? X_SUCCESS : X_ERROR;
+}
+
+x_return_stat_t xtr_dma_start (int channel, void * dest, const void * src, 
+                               size_t size)
+{
+    unsigned width;
+    uint32_t alignment = (uint32_t)dest | (uint32_t)src | (uint32_t)size;
+
+    if ((alignment & 0x7) == 0) {
+        width = 8;
+    }
+    else if ((alignment & 0x3) == 0) {
+        width = 4;
+    }
+    else if ((alignment & 0x1) == 0) {
+        width = 2;
+    }
+    else {
+        width = 1;
+    }
+    return xtr_dma_start_2d (channel, dest, src, width, size/width, 1,
+                             width, width, width, width);
+}
+
+/* xtr_dma_busy
+
+  Returns TRUE if the DMA channel is still transferring data. 
+*/
+
+x_bool_t xtr_dma_busy (int channel)
+{
+    return (e_dma_busy ((e_dma_id_t)channel) ? X_TRUE : X_FALSE);
+}
+
+/* xtr_dma_copy
+
+  Copies data using the DMA engine, waiting for the transfer to complete. 
+  If both channels are in use (by background exchanges) the data is 
+  copied by the CPU instead. 
+*/
+
+void xtr_dma_copy (void * dest, const void * src, size_t size)
+{
+    int channel = xtr_dma_acquire (dest);
+
+    if ((channel >= 0) && 
+        (X_SUCCESS == xtr_dma_start (channel, dest, src, size))) {
+        while (xtr_dma_busy (channel)) { } ;
+    }
+    else {
+        xtr_copy (dest, src, size);
+    }
+    if (channel >= 0) {
+        xtr_dma_release (channel);
+    }
+}
+
+/* x_calibrate_dma_thresholds
+
+  Measures the CPU and DMA copy times for a range of transfer sizes in 
+  each alignment class, setting the DMA threshold for the class to the
+  smallest size for which DMA was faster. If DMA never wins, the 
+  threshold is left unchanged. 
+
+  Timing uses CTIMER1 (CTIMER0 is used by x_usleep). 
+
+  Notes:
+    * The copies are between two buffers in local memory, which is a 
+      reasonable proxy for core-to-core writes since both are limited by
+      the rate at which the core can issue stores. 
+    * The buffers are on the stack, so the stack must have room for 
+      2*X_DMA_CALIBRATION_BUFFER_SIZE bytes plus a little. 
+    * The unaligned class is measured with the source and destination at
+      different offsets, as a CPU copy between co-misaligned buffers can
+      still move whole words once it has reached a boundary. 
+*/
+
+static unsigned xtr_time_copy (void * dest, const void * src, size_t size,
+                               x_bool_t use_dma)
+{
+    unsigned start_time;
+
+    start_time = e_ctimer_get (E_CTIMER_1);
+    if (use_dma) {
+        xtr_dma_copy (dest, src, size);
+    }
+    else {
+        xtr_copy (dest, src, size);
+    }
+    return start_time - e_ctimer_get (E_CTIMER_1);   // the timer counts down
+}
+
+x_return_stat_t x_calibrate_dma_thresholds (void)
+{
+    uint64_t source[X_DMA_CALIBRATION_BUFFER_SIZE/sizeof(uint64_t) + 1];
+    uint64_t destination[X_DMA_CALIBRATION_BUFFER_SIZE/sizeof(uint64_t) + 1];
+    size_t   threshold[X_DMA_ALIGNMENT_CLASSES] = { 0, 0, 0 };
+    size_t   source_offset[X_DMA_ALIGNMENT_CLASSES]      = { 1, 4, 0 };
+    size_t   destination_offset[X_DMA_ALIGNMENT_CLASSES] = { 0, 4, 0 };
+    size_t   size;
+    int      alignment_class;
+
+    e_ctimer_set (E_CTIMER_1, E_CTIMER_MAX);
+    e_ctimer_start (E_CTIMER_1, E_CTIMER_CLK);
+    for (alignment_class = 0; alignment_class < X_DMA_ALIGNMENT_CLASSES; 
+         alignment_class++) {
+        for (size = 64; 
+             (size <= X_DMA_CALIBRATION_BUFFER_SIZE) && 
+             (threshold[alignment_class] == 0);
+             size += 64) {
+            if (xtr_time_copy ((char*)destination + destination_offset[alignment_class],
+                               (char*)source + source_offset[alignment_class],
+                               size, X_TRUE) <
+                xtr_time_copy ((char*)destination + destination_offset[alignment_class],
+                               (char*)source + source_offset[alignment_class],
+                               size, X_FALSE)) {
+                threshold[alignment_class] = size;
+            }
+        }
+    }
+    e_ctimer_stop (E_CTIMER_1);
+    x_set_dma_thresholds (threshold[X_DMA_UNALIGNED], 
+                          threshold[X_DMA_WORD_ALIGNED],
+                          threshold[X_DMA_DOUBLEWORD_ALIGNED]);
+    return X_SUCCESS;
+}
+
+#else  // i.e. NOT __epiphany__
+
+/* Host tasks have no DMA engine, so there is nothing to calibrate. */
+
+x_return_stat_t x_calibrate_dma_thresholds (void)
+{
+    return X_WARNING;
+}
+
+#endif /* __epiphany__ */